@@ -0,0 +1,297 @@
+#include "Autopilot.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+static const double DOT_VALUE = 1;
+static const double PILL_VALUE = 3;
+static const double GHOST_VALUE = 8;
+static const double CLEAR_VALUE = 50;     // eating the last dot
+static const double DEATH_VALUE = -100;
+static const double DISCOUNT = 0.95;      // per corridor
+static const double DOT_DISTANCE = 0.2;   // leaf penalty per step to the nearest dot
+static const double KEEP_GOING = 0.5;     // so close calls don't turn him back and forth
+static const int GHOST_RANGE = 8;         // farther ghosts are left to the next decisions
+
+static Vector directionOf(const Vector& step)
+{
+	return Vector(float((step.x > 0) - (step.x < 0)), float((step.y > 0) - (step.y < 0)));
+}
+
+CAutopilot::CAutopilot(const CPacManGameScene* scene, sf::Time budget)
+{
+	m_scene = scene;
+	m_map = scene->m_walls->getMap();
+	setBudget(budget);
+}
+
+void CAutopilot::setBudget(sf::Time budget)
+{
+	m_budget = std::chrono::duration_cast<Clock::duration>(std::chrono::microseconds(budget.asMicroseconds()));
+}
+
+void CAutopilot::setLimits(int depth, int nodes)
+{
+	m_max_depth = std::max(depth, 1);
+	m_max_nodes = std::max(nodes, 0);
+}
+
+int CAutopilot::lastDepth() const
+{
+	return m_last_depth;
+}
+
+Vector CAutopilot::direction(CPacman* pacman)
+{
+	Vector cell = m_scene->m_walls->toMapCoordinates(pacman->getPosition());
+	if (cell != m_planned_cell)
+	{
+		m_planned_cell = cell;
+		plan(pacman, cell);
+	}
+
+	// he only turns on a new direction, at rest (after spawning) he needs a push the way he faces
+	if (!pacman->isMoving() && m_direction != Vector::zero && m_direction == pacman->getDirection())
+		pacman->setMovingPath(m_scene->m_walls->straightPath(cell, m_direction));
+	return m_direction;
+}
+
+int CAutopilot::index(const Vector& cell) const
+{
+	return (int)cell.x * m_map->height() + (int)cell.y;
+}
+
+void CAutopilot::plan(CPacman* pacman, const Vector& cell)
+{
+	CWalls* walls = m_scene->m_walls;
+	m_map = walls->getMap();
+	m_deadline = Clock::now() + m_budget;
+	m_nodes = 0;
+	m_direction = Vector::zero;
+	if (!m_map->inBounds(cell) || m_map->getCell(cell) != EMapBrickTypes::empty)
+		return;
+
+	int cells = m_map->width() * m_map->height();
+	m_visits.assign(cells, 0);
+	m_path.clear();
+	m_branch_dots = 0;
+	m_pills.assign(cells, 0);
+	for (CPill* pill : m_scene->m_pills)
+		if (pill->isEnabled())
+			m_pills[index(walls->toMapCoordinates(pill->getPosition()))] = 1;
+	updateDotField();
+
+	m_threats.clear();
+	for (CGhost* ghost : m_scene->m_ghosts)
+	{
+		if (!ghost->isEnabled() || m_threats.size() == MAX_GHOSTS)
+			continue;
+
+		Ghost threat;
+		switch (ghost->currentStateType())
+		{
+		case CGhostState::BinkyChase:
+		case CGhostState::PinkyChase:
+		case CGhostState::InkyChase:
+		case CGhostState::ClydeChase: threat.catch_rate = 0.9f; break;
+		case CGhostState::Scatter:    threat.catch_rate = 0.5f; break;
+		case CGhostState::Frightened: threat.catch_rate = 0; break;
+		default: continue; // eyes, in the house, being born: harmless for now
+		}
+		threat.frightened = threat.catch_rate == 0;
+		threat.cell = walls->toMapCoordinates(ghost->getPosition());
+		threat.pace = ghost->getSpeed() > 0 ? ghost->getSpeed() / ghost->NORMAL_SPEED : 1.f;
+		m_threats.push_back(threat);
+	}
+	updateThreatFields();
+
+	auto nodes = m_map->getNeighborNodes(cell, EMapBrickTypes::empty);
+	for (int depth = 1; depth <= m_max_depth; ++depth)
+	{
+		m_enforce_budget = depth > 1; // one corridor ahead is always searched
+		m_out_of_budget = false;
+		double best = -std::numeric_limits<double>::infinity();
+		Vector best_direction;
+		for (std::size_t i = 0; i < nodes.size(); ++i)
+		{
+			Vector direction = directionOf(nodes.steps[i]);
+			double value = corridor(cell, nodes.steps[i], 0, depth, 0);
+			if (direction == pacman->getDirection())
+				value += KEEP_GOING;
+			if (value > best)
+			{
+				best = value;
+				best_direction = direction;
+			}
+		}
+
+		if (m_out_of_budget)
+			break;
+		m_direction = best_direction;
+		m_last_depth = depth;
+	}
+}
+
+// steps to the nearest dot or pill from every cell, a multi-source BFS
+void CAutopilot::updateDotField()
+{
+	int width = m_map->width(), height = m_map->height();
+	m_dot_field.assign(width * height, -1);
+	m_queue.clear();
+	for (int x = 0; x < width; ++x)
+		for (int y = 0; y < height; ++y)
+			if (m_scene->m_dots->isDot(x, y) || m_pills[x * height + y])
+			{
+				m_dot_field[x * height + y] = 0;
+				m_queue.push_back(x * height + y);
+			}
+	spread(m_dot_field, 0);
+}
+
+// a stage looks threats up in its distance table, other maps get a BFS from each of them
+void CAutopilot::updateThreatFields()
+{
+	m_threat_fields.clear();
+	if (m_scene->m_walls->distances())
+		return;
+
+	std::size_t cells = std::size_t(m_map->width()) * m_map->height();
+	m_threat_fields.assign(m_threats.size() * cells, -1);
+	for (std::size_t g = 0; g < m_threats.size(); ++g)
+	{
+		const Vector& cell = m_threats[g].cell;
+		m_queue.clear();
+		if (!m_map->inBounds(cell) || m_map->getCell(cell) != EMapBrickTypes::empty)
+			continue; // unreachable, like a table lookup from outside the corridors
+		m_threat_fields[g * cells + index(cell)] = 0;
+		m_queue.push_back(index(cell));
+		spread(m_threat_fields, g * cells);
+	}
+}
+
+// BFS over the corridors from the cells in m_queue, whose steps are set already; the field's
+// cells start at offset
+void CAutopilot::spread(std::vector<int>& field, std::size_t offset)
+{
+	int height = m_map->height();
+	for (std::size_t head = 0; head < m_queue.size(); ++head)
+	{
+		int from = m_queue[head];
+		Vector cell(float(from / height), float(from % height)), next;
+		for (int i = 1; i < 5; ++i)
+		{
+			if (!m_map->neighbor(cell, directions[i], next) || m_map->getCell(next) != EMapBrickTypes::empty)
+				continue;
+			int to = index(next);
+			if (field[offset + to] < 0)
+			{
+				field[offset + to] = field[offset + from] + 1;
+				m_queue.push_back(to);
+			}
+		}
+	}
+}
+
+int CAutopilot::threatDistance(std::size_t ghost, const Vector& cell) const
+{
+	if (m_threat_fields.empty())
+		return m_scene->m_walls->mazeDistance(m_threats[ghost].cell, cell);
+	return m_threat_fields[ghost * m_map->width() * m_map->height() + index(cell)];
+}
+
+bool CAutopilot::outOfBudget()
+{
+	++m_nodes;
+	if (!m_enforce_budget || m_out_of_budget)
+		return m_out_of_budget;
+
+	if (m_max_nodes > 0)
+		m_out_of_budget = m_nodes > m_max_nodes;
+	else if ((m_nodes & 63) == 0)
+		m_out_of_budget = Clock::now() >= m_deadline;
+	return m_out_of_budget;
+}
+
+// Pac-Man's best choice at cell, arriving there time steps from now; back is where he came from
+double CAutopilot::search(const Vector& cell, const Vector& back, int time, int depth, unsigned eaten_ghosts)
+{
+	int dot_distance = m_dot_field[index(cell)];
+	double leaf = dot_distance < 0 ? 0 : -DOT_DISTANCE * dot_distance;
+	if (depth == 0 || outOfBudget())
+		return leaf;
+
+	auto nodes = m_map->getNeighborNodes(cell, EMapBrickTypes::empty);
+	double best = -std::numeric_limits<double>::infinity();
+	for (std::size_t i = 0; i < nodes.size(); ++i)
+		if (nodes.size() == 1 || directionOf(nodes.steps[i]) != back)
+			best = std::max(best, corridor(cell, nodes.steps[i], time, depth, eaten_ghosts));
+	return nodes.size() ? best : leaf;
+}
+
+// the chance node: walks the corridor from cell to the node step away, collecting what is on it,
+// and weighs the rest of the search by the chance that no ghost gets him on the way
+double CAutopilot::corridor(const Vector& cell, const Vector& step, int time, int depth, unsigned eaten_ghosts)
+{
+	Vector direction = directionOf(step);
+	int length = (int)(std::abs(step.x) + std::abs(step.y));
+	std::size_t path_size = m_path.size();
+	double gain = 0;
+	double danger[MAX_GHOSTS] = {}; // of each ghost at its worst cell of the corridor
+
+	Vector current = cell;
+	for (int k = 0; k <= length; ++k)
+	{
+		if (k > 0)
+		{
+			Vector next;
+			m_map->neighbor(current, direction, next);
+			current = next;
+			int i = index(current);
+			if (m_visits[i]++ == 0)
+			{
+				if (m_scene->m_dots->isDot((int)current.x, (int)current.y))
+				{
+					gain += DOT_VALUE;
+					if (++m_branch_dots == m_scene->m_dots->amount())
+						gain += CLEAR_VALUE;
+				}
+				else if (m_pills[i])
+					gain += PILL_VALUE;
+			}
+			m_path.push_back(i);
+		}
+		else if (time > 0)
+			continue; // weighed at the end of the corridor before
+
+		// a ghost that can get here before he leaves the cell: the nearer, the likelier it does
+		for (std::size_t g = 0; g < m_threats.size(); ++g)
+		{
+			const Ghost& ghost = m_threats[g];
+			int distance = threatDistance(g, current);
+			if (distance < 0 || distance > (time + k + 1) * ghost.pace)
+				continue;
+
+			if (ghost.frightened)
+			{
+				if (!(eaten_ghosts & (1u << g)))
+					gain += GHOST_VALUE;
+				eaten_ghosts |= 1u << g;
+			}
+			else
+				danger[g] = std::max(danger[g], ghost.catch_rate * std::max(0.0, 1.0 - double(distance) / GHOST_RANGE));
+		}
+	}
+
+	double survival = 1;
+	for (std::size_t g = 0; g < m_threats.size(); ++g)
+		survival *= 1 - danger[g];
+	double value = survival * gain + (1 - survival) * DEATH_VALUE;
+	if (survival > 0.01)
+		value += survival * DISCOUNT * search(current, -direction, time + length, depth - 1, eaten_ghosts);
+
+	for (std::size_t i = path_size; i < m_path.size(); ++i)
+		if (--m_visits[m_path[i]] == 0 && m_scene->m_dots->isDot(m_path[i] / m_map->height(), m_path[i] % m_map->height()))
+			--m_branch_dots;
+	m_path.resize(path_size);
+	return value;
+}
@@ -0,0 +1,70 @@
+#ifndef AUTOPILOT_H
+#define AUTOPILOT_H
+
+#include "PacManGame.h"
+#include <chrono>
+#include <vector>
+
+// Plays Pac-Man without a human, e.g. to score ghost AI variants over large batches. Each time he
+// enters a cell it searches the junction graph: Pac-Man picks the best turn, a chance node per
+// corridor stands for the ghosts, each dangerous one that can reach a cell of the corridor before
+// he leaves it catching him with a probability falling off with its maze distance. Iterative
+// deepening runs until the budget is spent and the deepest finished search decides; the next
+// corridor is always searched, so a tight budget plays worse but never stalls a tick.
+class CAutopilot : public CPacmanController
+{
+public:
+	CAutopilot(const CPacManGameScene* scene, sf::Time budget);
+	void setBudget(sf::Time budget);
+	// at most depth corridors ahead; nodes > 0 budgets nodes per decision instead of time,
+	// so games repeat exactly
+	void setLimits(int depth, int nodes = 0);
+	Vector direction(CPacman* pacman) override;
+	int lastDepth() const; // deepest finished search of the last decision
+
+private:
+	typedef std::chrono::steady_clock Clock;
+	enum { MAX_GHOSTS = 8 };
+
+	struct Ghost
+	{
+		Vector cell;
+		float pace;        // its speed over Pac-Man's
+		float catch_rate;  // chance it catches him if it can get there in time
+		bool frightened;
+	};
+
+	void plan(CPacman* pacman, const Vector& cell);
+	void updateDotField();
+	void updateThreatFields();
+	void spread(std::vector<int>& field, std::size_t offset);
+	int threatDistance(std::size_t ghost, const Vector& cell) const;
+	double search(const Vector& cell, const Vector& back, int time, int depth, unsigned eaten_ghosts);
+	double corridor(const Vector& cell, const Vector& step, int time, int depth, unsigned eaten_ghosts);
+	bool outOfBudget(); // counts a node
+	int index(const Vector& cell) const;
+
+	const CPacManGameScene* m_scene;
+	TileMap<EMapBrickTypes>* m_map;
+	Clock::duration m_budget;
+	Clock::time_point m_deadline;
+	int m_max_depth = 12;
+	int m_max_nodes = 0;
+	int m_nodes = 0;
+	bool m_enforce_budget = false;
+	bool m_out_of_budget = false;
+	int m_last_depth = 0;
+
+	Vector m_planned_cell = Vector(-1, -1);
+	Vector m_direction;
+	std::vector<Ghost> m_threats;
+	std::vector<int> m_visits;       // per cell: times the branch being searched passes it
+	std::vector<int> m_path;         // cells the branch passes, to undo m_visits on the way back
+	int m_branch_dots = 0;           // dots on them
+	std::vector<char> m_pills;
+	std::vector<int> m_dot_field;    // steps to the nearest dot or pill, -1 if none reachable
+	std::vector<int> m_threat_fields; // without a distance table: steps from each threat, a map each
+	std::vector<int> m_queue;
+};
+
+#endif
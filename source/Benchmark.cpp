@@ -0,0 +1,321 @@
+// PacManBench [filter]: micro-benchmarks of the code that runs every tick.
+// Prints ns/op and heap allocations/op, run it from the build directory (needs res/).
+#include "PacManGame.h"
+#include "SoftwareRenderer.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+static std::size_t s_allocations = 0;
+
+void* operator new(std::size_t size)
+{
+	++s_allocations;
+	if (void* ptr = std::malloc(size ? size : 1))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+static std::string s_filter;
+static volatile float s_sink = 0;
+
+// repeats run() for at least 200 ms, run() performs ops_per_run operations
+template <typename F>
+void bench(const std::string& name, long ops_per_run, F run)
+{
+	if (!s_filter.empty() && name.find(s_filter) == std::string::npos)
+		return;
+
+	typedef std::chrono::steady_clock Clock;
+	run(); // warm up caches and lazy buffers
+
+	long runs = 0;
+	std::size_t allocations = s_allocations;
+	auto start = Clock::now();
+	double elapsed = 0;
+	do
+	{
+		run();
+		++runs;
+		elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+	} while (elapsed < 0.2);
+	allocations = s_allocations - allocations;
+
+	double ops = double(runs) * ops_per_run;
+	std::printf("%-48s %12.1f ns/op %10.2f allocs/op\n", name.c_str(), elapsed * 1e9 / ops, allocations / ops);
+}
+
+// perfect maze carved from odd cells, then some walls knocked out so it has loops and junctions
+static void makeMaze(TileMap<EMapBrickTypes>* map, sf::Uint64 seed)
+{
+	CRandom random(seed);
+	int width = map->width(), height = map->height();
+	map->clear(EMapBrickTypes::full);
+
+	std::vector<Vector> stack = { Vector(1, 1) };
+	map->setCell(1, 1, EMapBrickTypes::empty);
+	while (!stack.empty())
+	{
+		Vector cell = stack.back();
+		Vector next[4];
+		int count = 0;
+		for (int i = 1; i < 5; ++i)
+		{
+			Vector candidate = cell + directions[i] * 2;
+			if (candidate.x > 0 && candidate.y > 0 && candidate.x < width - 1 && candidate.y < height - 1 &&
+				map->getCell(candidate) == EMapBrickTypes::full)
+				next[count++] = candidate;
+		}
+
+		if (count == 0)
+		{
+			stack.pop_back();
+			continue;
+		}
+
+		Vector chosen = next[random.nextInt(count)];
+		Vector wall = (cell + chosen) / 2;
+		map->setCell(wall.x, wall.y, EMapBrickTypes::empty);
+		map->setCell(chosen.x, chosen.y, EMapBrickTypes::empty);
+		stack.push_back(chosen);
+	}
+
+	for (int x = 1; x < width - 1; ++x)
+		for (int y = 1; y < height - 1; ++y)
+			if ((x + y) % 2 == 1 && random.nextInt(8) == 0)
+				map->setCell(x, y, EMapBrickTypes::empty);
+}
+
+static void benchMap(CGameContext& context, const std::string& label, CWalls& walls)
+{
+	TileMap<EMapBrickTypes>* map = walls.getMap();
+	TileMap<EMapBrickTypes> source(map->width(), map->height());
+	source = *map;
+	walls.lining();
+
+	std::vector<Vector> cells = map->getCells(EMapBrickTypes::empty);
+	long cells_count = (long)cells.size();
+	long map_size = long(map->width()) * map->height();
+
+	bench(label + " TileMap::getNeighborNodes", cells_count, [&]()
+	{
+		for (auto& cell : cells)
+			s_sink = s_sink + map->getNeighborNodes(cell, EMapBrickTypes::empty).size();
+	});
+
+	bench(label + " TileMap::traceLine", cells_count * 4, [&]()
+	{
+		for (auto& cell : cells)
+			for (int i = 1; i < 5; ++i)
+				s_sink = s_sink + map->traceLine(cell, directions[i], EMapBrickTypes::empty).x;
+	});
+
+	bench(label + " TileMap::getCellDegree", map_size, [&]()
+	{
+		for (int x = 0; x < map->width(); ++x)
+			for (int y = 0; y < map->height(); ++y)
+				s_sink = s_sink + map->getCellDegree(Vector(x, y), EMapBrickTypes::empty);
+	});
+
+	bench(label + " TileMap::getCells", 1, [&]()
+	{
+		s_sink = s_sink + map->getCells(EMapBrickTypes::empty).size();
+	});
+
+	TileMap<EMapBrickTypes> lined(map->width(), map->height());
+	lined = *map;
+	bench(label + " TileMap copy", 1, [&]()
+	{
+		*map = source;
+	});
+	*map = lined; // the benches below run on the lined map, as the game does
+
+	bench(label + " TileMap::buildJunctionGraph", 1, [&]()
+	{
+		map->buildJunctionGraph(EMapBrickTypes::empty);
+	});
+
+	CFlowField field;
+	field.setMap(*map, EMapBrickTypes::empty);
+	int field_target = 0;
+	bench(label + " CFlowField::update", 1, [&]()
+	{
+		field.update(cells[field_target++ % cells_count]);
+		s_sink = s_sink + field.distance(cells[0]);
+	});
+
+	CDistanceTable table;
+	if (cells_count <= CDistanceTable::MAX_CELLS)
+		bench(label + " CDistanceTable::build", 1, [&]()
+		{
+			table.build(*map, EMapBrickTypes::empty);
+		});
+	else
+		std::printf("%-48s %12s (%ld cells, not tabled)\n", (label + " CDistanceTable::build").c_str(), "skipped", cells_count);
+
+	bench(label + " CWalls::lining (incl. copy)", 1, [&]()
+	{
+		*map = source;
+		walls.lining();
+	});
+	*map = lined;
+	map->buildJunctionGraph(EMapBrickTypes::empty);
+
+	CGhost ghost(&context, "Binky", NULL, &walls);
+	CRandom random(1);
+	std::vector<Vector> targets;
+	for (int i = 0; i < cells_count; ++i)
+		targets.push_back(walls.toPixelCoordinates(cells[random.nextInt(cells_count)]));
+
+	bench(label + " CGhost::moveToTarget", cells_count, [&]()
+	{
+		for (int i = 0; i < cells_count; ++i)
+		{
+			ghost.setPosition(walls.toPixelCoordinates(cells[i]));
+			ghost.moveToTarget(targets[i]);
+		}
+		s_sink = s_sink + ghost.getTargetPos().x;
+	});
+}
+
+// the stage1 board (walls and all dots) drawn on the CPU at window size and at a quarter of it
+static void benchRaster(CGameContext& context)
+{
+	CWalls walls(&context, 28, 31);
+	walls.load("res/levels/stage1.txt");
+	walls.lining();
+	CDots dots(&walls);
+	dots.fill(&walls);
+	dots.reset();
+
+	CDisplayList list;
+	list.view = sf::View(sf::FloatRect(0, 0, 1000, 850));
+	CSpriteBatch& batch = CSpriteBatch::instance();
+	batch.beginRecording(&list);
+	walls.draw(nullptr);
+	dots.draw(nullptr);
+	batch.endRecording();
+
+	sf::Image atlas;
+	atlas.loadFromFile("res/sprites.png");
+	for (auto size : { sf::Vector2u(1000, 850), sf::Vector2u(250, 212) })
+	{
+		CSoftwareRenderer renderer;
+		renderer.create(size.x, size.y);
+		renderer.setTexture(context.textureManager().get("texture"), atlas);
+		bench("CSoftwareRenderer stage1 " + toString((int)size.x) + "x" + toString((int)size.y), 1, [&]()
+		{
+			renderer.clear(sf::Color::White);
+			renderer.draw(list);
+			s_sink = s_sink + renderer.pixels()[0];
+		});
+	}
+}
+
+static void benchGeometry()
+{
+	const int count = 1024;
+	CRandom random(7);
+	std::vector<Vector> points;
+	std::vector<Rect> rects;
+	for (int i = 0; i < count; ++i)
+	{
+		points.emplace_back(float(random.nextInt(1000)), float(random.nextInt(1000)));
+		rects.emplace_back(float(random.nextInt(1000)), float(random.nextInt(1000)), float(random.nextInt(100) + 1), float(random.nextInt(100) + 1));
+	}
+
+	bench("Vector +,-,*", count, [&]()
+	{
+		Vector sum;
+		for (int i = 1; i < count; ++i)
+			sum += (points[i] - points[i - 1]) * 0.5f + points[i];
+		s_sink = s_sink + sum.x;
+	});
+
+	bench("Vector::length", count, [&]()
+	{
+		float sum = 0;
+		for (auto& point : points)
+			sum += point.length();
+		s_sink = s_sink + sum;
+	});
+
+	bench("Vector::normalized", count, [&]()
+	{
+		Vector sum;
+		for (auto& point : points)
+			sum += (point + Vector(1, 1)).normalized();
+		s_sink = s_sink + sum.x;
+	});
+
+	bench("Vector::moveTowards", count, [&]()
+	{
+		Vector sum;
+		for (int i = 1; i < count; ++i)
+			sum += Vector::moveTowards(points[i - 1], points[i], 3.f);
+		s_sink = s_sink + sum.x;
+	});
+
+	bench("Rect::isIntersect", count, [&]()
+	{
+		int hits = 0;
+		for (int i = 1; i < count; ++i)
+			hits += rects[i].isIntersect(rects[i - 1]);
+		s_sink = s_sink + hits;
+	});
+
+	bench("Rect::isContain(Vector)", count, [&]()
+	{
+		int hits = 0;
+		for (int i = 0; i < count; ++i)
+			hits += rects[i].isContain(points[i]);
+		s_sink = s_sink + hits;
+	});
+
+	bench("Rect::getIntersection", count, [&]()
+	{
+		float area = 0;
+		for (int i = 1; i < count; ++i)
+			area += rects[i].getIntersection(rects[i - 1]).width();
+		s_sink = s_sink + area;
+	});
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1)
+		s_filter = argv[1];
+
+	CTextureManager texture_manager;
+	CFontManager font_manager;
+	CSoundManager sound_manager;
+	texture_manager.loadFromFile("texture", "res/sprites.png");
+	CGameContext context(texture_manager, font_manager, sound_manager);
+	context.setMuted(true);
+
+	benchGeometry();
+
+	for (auto& stage : { "stage1", "stage2" })
+	{
+		CWalls walls(&context, 28, 31);
+		walls.load("res/levels/" + std::string(stage) + ".txt");
+		benchMap(context, stage, walls);
+	}
+
+	benchRaster(context);
+
+	for (int size : { 127, 511 })
+	{
+		CWalls walls(&context, size, size);
+		makeMaze(walls.getMap(), size);
+		benchMap(context, "maze" + toString(size), walls);
+	}
+
+	return 0;
+}
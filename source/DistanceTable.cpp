@@ -0,0 +1,203 @@
+#include "DistanceTable.h"
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <cstdio>
+
+static const char s_distance_table_magic[4] = { 'P', 'M', 'D', '2' };
+static const sf::Uint16 s_unreachable = 0xFFFF;
+
+void CDistanceTable::build(int width, int height, const std::vector<bool>& walkable, bool wrap_x, bool wrap_y)
+{
+	m_width = width;
+	m_height = height;
+	m_index.assign(width * height, -1);
+	std::vector<int> cells;
+	for (int i = 0; i < width * height; ++i)
+		if (walkable[i])
+		{
+			m_index[i] = (int)cells.size();
+			cells.push_back(i);
+		}
+
+	m_count = (int)cells.size();
+	if (m_count > MAX_CELLS)
+	{
+		m_count = 0;
+		m_index.clear();
+		m_distances.clear();
+		return;
+	}
+
+	m_distances.assign(std::size_t(m_count) * m_count, s_unreachable);
+	std::vector<int> queue(m_count);
+	for (int source = 0; source < m_count; ++source)
+	{
+		sf::Uint16* row = &m_distances[std::size_t(source) * m_count];
+		int head = 0, tail = 0;
+		queue[tail++] = cells[source];
+		row[source] = 0;
+		while (head < tail)
+		{
+			int cell = queue[head++];
+			int x = cell / height, y = cell % height;
+			sf::Uint16 next = row[m_index[cell]] + 1;
+			int neighbors[4][2] = { { x - 1, y }, { x, y - 1 }, { x, y + 1 }, { x + 1, y } };
+			for (auto& neighbor : neighbors)
+			{
+				if (wrap_x)
+					neighbor[0] = (neighbor[0] + width) % width;
+				if (wrap_y)
+					neighbor[1] = (neighbor[1] + height) % height;
+				if (neighbor[0] < 0 || neighbor[1] < 0 || neighbor[0] >= width || neighbor[1] >= height)
+					continue;
+				int other = neighbor[0] * height + neighbor[1];
+				int column = m_index[other];
+				if (column >= 0 && row[column] == s_unreachable)
+				{
+					row[column] = next;
+					queue[tail++] = other;
+				}
+			}
+		}
+	}
+}
+
+bool CDistanceTable::isBuilt() const
+{
+	return m_count > 0;
+}
+
+int CDistanceTable::index(const Vector& cell) const
+{
+	int x = (int)cell.x, y = (int)cell.y;
+	if (x < 0 || y < 0 || x >= m_width || y >= m_height || m_index.empty())
+		return -1;
+	return m_index[x * m_height + y];
+}
+
+int CDistanceTable::distance(const Vector& from, const Vector& to) const
+{
+	int row = index(from), column = index(to);
+	if (row < 0 || column < 0)
+		return -1;
+	sf::Uint16 distance = m_distances[std::size_t(row) * m_count + column];
+	return distance == s_unreachable ? -1 : distance;
+}
+
+int CDistanceTable::cellsCount() const
+{
+	return m_count;
+}
+
+// magic, key, width, height, walkable mask (a byte per cell), table; native byte order
+bool CDistanceTable::save(const std::string& file_path, sf::Uint64 key) const
+{
+	if (!isBuilt())
+		return false;
+
+	// written aside and renamed, so a reader never sees half a table
+	std::string temp_path = file_path + ".tmp";
+	{
+		std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			return false;
+
+		sf::Int32 size[2] = { m_width, m_height };
+		file.write(s_distance_table_magic, sizeof(s_distance_table_magic));
+		file.write((const char*)&key, sizeof(key));
+		file.write((const char*)size, sizeof(size));
+		for (int index : m_index)
+			file.put(index >= 0 ? 1 : 0);
+		file.write((const char*)m_distances.data(), m_distances.size() * sizeof(sf::Uint16));
+		if (!file)
+			return false;
+	}
+	std::remove(file_path.c_str());
+	return std::rename(temp_path.c_str(), file_path.c_str()) == 0;
+}
+
+bool CDistanceTable::load(const std::string& file_path, sf::Uint64 key)
+{
+	std::ifstream file(file_path, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	char magic[4];
+	sf::Uint64 file_key = 0;
+	sf::Int32 size[2] = {};
+	file.read(magic, sizeof(magic));
+	file.read((char*)&file_key, sizeof(file_key));
+	file.read((char*)size, sizeof(size));
+	if (!file || !std::equal(magic, magic + 4, s_distance_table_magic) || file_key != key ||
+		size[0] <= 0 || size[1] <= 0 || size[0] * size[1] > 1 << 24)
+		return false;
+
+	std::vector<char> mask(size[0] * size[1]);
+	file.read(mask.data(), mask.size());
+	std::vector<int> index(mask.size(), -1);
+	int count = 0;
+	for (std::size_t i = 0; i < mask.size(); ++i)
+		if (mask[i])
+			index[i] = count++;
+	if (!file || count == 0 || count > MAX_CELLS)
+		return false;
+
+	std::vector<sf::Uint16> distances(std::size_t(count) * count);
+	file.read((char*)distances.data(), distances.size() * sizeof(sf::Uint16));
+	if (!file)
+		return false;
+
+	m_width = size[0];
+	m_height = size[1];
+	m_count = count;
+	m_index.swap(index);
+	m_distances.swap(distances);
+	return true;
+}
+
+// FNV-1a of the level's bytes, with the file format folded in so old caches are rebuilt
+sf::Uint64 CDistanceTable::fileKey(const std::string& file_path)
+{
+	std::ifstream file(file_path, std::ios::binary);
+	if (!file.is_open())
+		return 0;
+
+	sf::Uint64 hash = 14695981039346656037ULL;
+	for (char c : std::string(s_distance_table_magic, 4) + std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()))
+	{
+		hash ^= (unsigned char)c;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+std::shared_ptr<const CDistanceTable> CDistanceTable::shared(sf::Uint64 key, bool wrap_x, bool wrap_y,
+	const std::string& cache_path, const std::function<void(CDistanceTable&)>& build)
+{
+	// the same level makes another table when its edges wrap: hash on with the flags
+	for (unsigned char wraps : { (unsigned char)wrap_x, (unsigned char)wrap_y })
+	{
+		key ^= wraps;
+		key *= 1099511628211ULL;
+	}
+
+	static std::mutex mutex;
+	static std::map<sf::Uint64, std::shared_ptr<const CDistanceTable>> tables;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto& table = tables[key];
+	if (!table)
+	{
+		auto created = std::make_shared<CDistanceTable>();
+		if (!created->load(cache_path, key))
+		{
+			build(*created);
+			created->save(cache_path, key);
+		}
+		table = created;
+	}
+	return table;
+}
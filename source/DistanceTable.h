@@ -0,0 +1,53 @@
+#ifndef DISTANCETABLE_H
+#define DISTANCETABLE_H
+
+#include "TileMap.h"
+#include <SFML/Config.hpp>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Maze distance between every pair of walkable cells, one BFS per cell at load time, so a
+// lookup replaces the straight line guess of "how far" around walls. Distances are uint16
+// in a walkable x walkable table (~180 KB for a stage); bigger maps aren't tabled at all.
+class CDistanceTable
+{
+public:
+	enum { MAX_CELLS = 4096 };
+
+	template <typename T>
+	void build(const TileMap<T>& map, const T& walkable)
+	{
+		std::vector<bool> cells(map.width() * map.height());
+		for (int x = 0; x < map.width(); ++x)
+			for (int y = 0; y < map.height(); ++y)
+				cells[x * map.height() + y] = map.getCell(x, y) == walkable;
+		build(map.width(), map.height(), cells, map.wrapsHorizontally(), map.wrapsVertically());
+	}
+
+	// walkable is indexed x * height + y; wrapping axes connect opposite edges
+	void build(int width, int height, const std::vector<bool>& walkable, bool wrap_x = false, bool wrap_y = false);
+	bool isBuilt() const;
+	// steps from one cell to the other, -1 if either isn't walkable or there is no way between them
+	int distance(const Vector& from, const Vector& to) const;
+	int cellsCount() const;
+
+	bool load(const std::string& file_path, sf::Uint64 key);
+	bool save(const std::string& file_path, sf::Uint64 key) const;
+	// key for a table built from this level file, 0 if it can't be read
+	static sf::Uint64 fileKey(const std::string& file_path);
+	// one table per key and wrapping for the whole process (simulations on worker threads share
+	// it); built on first use unless cache_path holds one for the same key, then written there
+	static std::shared_ptr<const CDistanceTable> shared(sf::Uint64 key, bool wrap_x, bool wrap_y,
+		const std::string& cache_path, const std::function<void(CDistanceTable&)>& build);
+
+private:
+	int index(const Vector& cell) const;
+	int m_width = 0, m_height = 0;
+	int m_count = 0;
+	std::vector<int> m_index;            // cell -> row of the table, -1 for walls
+	std::vector<sf::Uint16> m_distances; // m_count x m_count
+};
+
+#endif
@@ -0,0 +1,52 @@
+#include "FlowField.h"
+#include <algorithm>
+
+int CFlowField::index(const Vector& cell) const
+{
+	int x = (int)cell.x, y = (int)cell.y;
+	if (x < 0 || y < 0 || x >= m_width || y >= m_height)
+		return -1;
+	return x * m_height + y;
+}
+
+void CFlowField::update(const Vector& target)
+{
+	if (m_valid && target == m_target)
+		return;
+
+	m_target = target;
+	m_valid = true;
+	std::fill(m_distances.begin(), m_distances.end(), -1);
+
+	int start = index(target);
+	if (start < 0 || !m_walkable[start])
+		return;
+
+	m_queue.resize(m_walkable.size());
+	int head = 0, tail = 0;
+	m_queue[tail++] = start;
+	m_distances[start] = 0;
+	while (head < tail)
+	{
+		int cell = m_queue[head++];
+		int x = cell / m_height, y = cell % m_height;
+		int next = m_distances[cell] + 1;
+		// neighbors in the order of directions[], -1 past an edge that doesn't wrap
+		int neighbors[4] =
+		{
+			x > 0 ? cell - m_height : m_wrap_x ? cell + (m_width - 1) * m_height : -1,
+			y > 0 ? cell - 1 : m_wrap_y ? cell + m_height - 1 : -1,
+			y < m_height - 1 ? cell + 1 : m_wrap_y ? cell - (m_height - 1) : -1,
+			x < m_width - 1 ? cell + m_height : m_wrap_x ? cell - (m_width - 1) * m_height : -1
+		};
+		for (int neighbor : neighbors)
+			if (neighbor >= 0 && m_walkable[neighbor] && m_distances[neighbor] < 0)
+				m_distances[m_queue[tail++] = neighbor] = next;
+	}
+}
+
+int CFlowField::distance(const Vector& cell) const
+{
+	int i = index(cell);
+	return i < 0 ? -1 : m_distances[i];
+}
@@ -0,0 +1,64 @@
+#ifndef FLOWFIELD_H
+#define FLOWFIELD_H
+
+#include "TileMap.h"
+#include <vector>
+
+// Steps to one target cell from every walkable cell, for everyone chasing the same target:
+// a single BFS whenever the target enters another cell, then each chaser reads its way in
+// O(1), however many of them there are. Unlike CDistanceTable it works on maps of any size.
+class CFlowField
+{
+public:
+	template <typename T>
+	void setMap(const TileMap<T>& map, const T& walkable)
+	{
+		m_width = map.width();
+		m_height = map.height();
+		m_wrap_x = map.wrapsHorizontally();
+		m_wrap_y = map.wrapsVertically();
+		m_walkable.resize(m_width * m_height);
+		for (int x = 0; x < m_width; ++x)
+			for (int y = 0; y < m_height; ++y)
+				m_walkable[x * m_height + y] = map.getCell(x, y) == walkable;
+		m_distances.assign(m_walkable.size(), -1);
+		m_valid = false;
+	}
+
+	// rebuilds the field only if target is another cell than last time
+	void update(const Vector& target);
+	// steps to the target, -1 for walls and cells it can't be reached from
+	int distance(const Vector& cell) const;
+
+	// of the nodes next to a cell (TileMap::NeighborNodes), the step towards the one nearest
+	// the target, the last of equals; the node at skip is never taken (no turning back). False,
+	// and step untouched, when some node can't reach the target
+	template <typename Nodes>
+	bool direction(const Nodes& nodes, const Vector& skip, Vector& step) const
+	{
+		int distances[4];
+		for (int i = 0; i < nodes.count; ++i)
+			if ((distances[i] = distance(nodes.cells[i])) < 0)
+				return false;
+
+		int nearest = -1;
+		for (int i = 0; i < nodes.count; ++i)
+			if (nodes.cells[i] != skip && (nearest < 0 || distances[i] <= distances[nearest]))
+				nearest = i;
+		if (nearest >= 0)
+			step = nodes.steps[nearest];
+		return true;
+	}
+
+private:
+	int index(const Vector& cell) const;
+	int m_width = 0, m_height = 0;
+	bool m_wrap_x = false, m_wrap_y = false;
+	std::vector<char> m_walkable;
+	std::vector<int> m_distances;
+	std::vector<int> m_queue;
+	Vector m_target;
+	bool m_valid = false;
+};
+
+#endif
@@ -0,0 +1,183 @@
+#include "FramePacer.h"
+#include <algorithm>
+#include <iomanip>
+#include <thread>
+
+void CFramePacer::setTargetRate(float hz)
+{
+	m_rate = std::max(0.f, hz);
+	m_period = m_rate > 0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / m_rate)) : Clock::duration::zero();
+	m_started = false;
+}
+
+float CFramePacer::targetRate() const
+{
+	return m_rate;
+}
+
+void CFramePacer::endFrame()
+{
+	Clock::time_point now = Clock::now();
+	if (!m_started)
+	{
+		m_started = true;
+		m_last_frame = now;
+		m_deadline = now + m_period;
+		return;
+	}
+
+	sf::Uint64 ns = (sf::Uint64)std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_last_frame).count();
+	m_last_frame = now;
+	bool missed = m_period > Clock::duration::zero() && now > m_deadline;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_total.frame_time.add(ns);
+		m_recent.frame_time.add(ns);
+		m_total.missed += missed;
+		m_recent.missed += missed;
+	}
+
+	if (m_period == Clock::duration::zero())
+		return;
+
+	if (missed)
+		m_deadline = now; // start over from here, a burst of short frames would only look worse
+	else
+		waitUntil(m_deadline);
+	m_deadline += m_period;
+}
+
+// sleeps for all but the usual oversleep, then yields until the deadline
+void CFramePacer::waitUntil(Clock::time_point deadline)
+{
+	Clock::time_point now = Clock::now();
+	if (deadline - now > m_oversleep)
+	{
+		Clock::duration request = deadline - now - m_oversleep;
+		std::this_thread::sleep_for(request);
+		Clock::time_point woke = Clock::now();
+		Clock::duration late = std::max(Clock::duration::zero(), woke - now - request);
+		// quick to grow, slow to shrink: a late wake up costs a missed deadline, spinning a little CPU
+		if (late > m_oversleep)
+			m_oversleep = (m_oversleep + late) / 2;
+		else
+			m_oversleep -= (m_oversleep - late) / 16;
+		now = woke;
+	}
+
+	while (now < deadline)
+	{
+		std::this_thread::yield();
+		now = Clock::now();
+	}
+}
+
+void CFramePacer::addUpdateTime(sf::Time time)
+{
+	sf::Uint64 ns = (sf::Uint64)time.asMicroseconds() * 1000;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_total.update_time.add(ns);
+	m_recent.update_time.add(ns);
+}
+
+CFramePacer::Stats CFramePacer::total() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_total;
+}
+
+CFramePacer::Stats CFramePacer::takeRecent()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Stats recent = m_recent;
+	m_recent = Stats();
+	return recent;
+}
+
+void CFramePacer::writeSummary(std::ostream& stream) const
+{
+	writeSummary(stream, total());
+}
+
+// "fps: 119.8, frame p50/p99: 8.3/9.1 ms, update p99: 0.42 ms, missed: 3"
+void CFramePacer::writeSummary(std::ostream& stream, const Stats& stats)
+{
+	const CProfiler::Histogram& frame = stats.frame_time;
+	const CProfiler::Histogram& update = stats.update_time;
+	stream << std::fixed << std::setprecision(1) << "fps: " << (frame.total ? frame.count * 1e9 / frame.total : 0.0)
+		<< std::setprecision(2) << ", frame p50/p99: " << frame.percentile(0.5) / 1e6 << "/" << frame.percentile(0.99) / 1e6 << " ms"
+		<< ", update p99: " << update.percentile(0.99) / 1e6 << " ms"
+		<< ", missed: " << stats.missed;
+}
+
+//-----------------------------------------------------------------------------------------------
+static const char* s_policy_names[] = { "unbounded", "limit", "dilate", "drop" };
+
+void CCatchUp::setPolicy(Policy policy, int max_ticks)
+{
+	m_policy = policy;
+	m_max_ticks = std::max(1, max_ticks);
+}
+
+CCatchUp::Policy CCatchUp::policy() const
+{
+	return m_policy;
+}
+
+int CCatchUp::ticks(sf::Time& accumulator, sf::Time elapsed, sf::Time step)
+{
+	sf::Time budget = step * (float)m_max_ticks;
+	++m_stats.frames;
+	m_stats.max_backlog = std::max(m_stats.max_backlog, accumulator + elapsed);
+
+	bool triggered = false;
+	if (m_policy == dilate && elapsed > budget)
+	{
+		m_stats.skipped += elapsed - budget;
+		elapsed = budget;
+		triggered = true;
+	}
+	accumulator += elapsed;
+
+	int ticks = int(accumulator.asMicroseconds() / std::max<sf::Int64>(1, step.asMicroseconds()));
+	if (m_policy != unbounded && ticks > m_max_ticks)
+	{
+		ticks = m_max_ticks;
+		triggered = true;
+		if (m_policy == drop)
+		{
+			sf::Time keep = sf::microseconds(accumulator.asMicroseconds() % step.asMicroseconds()) + budget;
+			m_stats.skipped += accumulator - keep;
+			accumulator = keep;
+		}
+	}
+
+	m_stats.triggered += triggered;
+	m_stats.most_ticks = std::max(m_stats.most_ticks, ticks);
+	return ticks;
+}
+
+const CCatchUp::Stats& CCatchUp::stats() const
+{
+	return m_stats;
+}
+
+// "catch-up dilate: 3 of 5120 frames, most ticks: 5, max backlog: 412 ms, skipped: 330 ms"
+void CCatchUp::writeSummary(std::ostream& stream) const
+{
+	stream << "catch-up " << s_policy_names[m_policy] << ": " << m_stats.triggered << " of " << m_stats.frames << " frames"
+		<< ", most ticks: " << m_stats.most_ticks
+		<< ", max backlog: " << m_stats.max_backlog.asMilliseconds() << " ms"
+		<< ", skipped: " << m_stats.skipped.asMilliseconds() << " ms";
+}
+
+bool CCatchUp::parse(const std::string& name, Policy& policy)
+{
+	for (int i = 0; i < 4; ++i)
+		if (name == s_policy_names[i])
+		{
+			policy = Policy(i);
+			return true;
+		}
+	return false;
+}
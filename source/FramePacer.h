@@ -0,0 +1,80 @@
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+#include "Profiler.h"
+#include <SFML/System.hpp>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+// Holds a loop to a target rate by sleeping until the next frame's deadline, so the time spent
+// drawing is not slept again on top. sleep() wakes up late by a learnt margin, which is spun
+// away instead. A frame that ends past its deadline counts as missed and the schedule restarts
+// from it rather than rushing to catch up. With rate 0 (vsync, or unlimited) it only measures.
+class CFramePacer
+{
+public:
+	struct Stats
+	{
+		CProfiler::Histogram frame_time;  // ns between the ends of consecutive frames
+		CProfiler::Histogram update_time; // ns per simulation tick
+		sf::Uint64 missed = 0;
+	};
+
+	void setTargetRate(float hz);
+	float targetRate() const;
+	// after display(): records the frame and waits for the next deadline
+	void endFrame();
+	// may be called from another thread than endFrame()
+	void addUpdateTime(sf::Time time);
+	Stats total() const;
+	// what was recorded since the previous call, for overlays
+	Stats takeRecent();
+	void writeSummary(std::ostream& stream) const;
+	static void writeSummary(std::ostream& stream, const Stats& stats);
+
+private:
+	typedef std::chrono::steady_clock Clock;
+	void waitUntil(Clock::time_point deadline);
+	mutable std::mutex m_mutex;
+	Stats m_total, m_recent;
+	float m_rate = 0;
+	Clock::duration m_period = Clock::duration::zero();
+	Clock::duration m_oversleep = std::chrono::microseconds(500);
+	Clock::time_point m_last_frame, m_deadline;
+	bool m_started = false;
+};
+
+// What the update loop does once it is more than max ticks behind (a window drag, a swap
+// stall, a loaded host). Unbounded catch-up makes every late frame later still; limit (the
+// default) runs at most max ticks per frame and carries the rest over, dilate lets the game fall
+// behind the clock (slow motion) and drop discards the backlog. Every policy reports through
+// stats(). Only the update thread may use it.
+class CCatchUp
+{
+public:
+	enum Policy { unbounded, limit, dilate, drop };
+	struct Stats
+	{
+		sf::Uint64 frames = 0;
+		sf::Uint64 triggered = 0; // frames the policy changed
+		int most_ticks = 0;       // in one frame
+		sf::Time max_backlog;     // before the policy applied
+		sf::Time skipped;         // slowed down (dilate) or discarded (drop)
+	};
+
+	void setPolicy(Policy policy, int max_ticks = 5);
+	Policy policy() const;
+	// adds the time since the previous frame to accumulator and returns how many steps to tick now
+	int ticks(sf::Time& accumulator, sf::Time elapsed, sf::Time step);
+	const Stats& stats() const;
+	void writeSummary(std::ostream& stream) const;
+	static bool parse(const std::string& name, Policy& policy);
+
+private:
+	Policy m_policy = limit;
+	int m_max_ticks = 5;
+	Stats m_stats;
+};
+
+#endif
@@ -1,6 +1,12 @@
 
 #include "GameEngine.h"
+#include "Profiler.h"
+#include "SpriteBatch.h"
+#include "SoftwareRenderer.h"
+#include "GlyphCache.h"
 #include <assert.h>
+#include <atomic>
+#include <mutex>
 
 
 //----------------------------------------------------------------------------------------------
@@ -83,8 +89,273 @@ bool CInputManager::isKeyPressed(const sf::Keyboard::Key& key)
 void CInputManager::update(int delta_time)
 {
 	std::swap(m_keys_now_ptr, m_keys_prev_ptr);
-	for (auto& key : *m_keys_now_ptr)
-		key.second = sf::Keyboard::isKeyPressed(key.first);
+
+	if (m_player)
+	{
+		sf::Uint32 mask = 0;
+		m_player->next(mask);
+		const auto& keys = m_player->keys();
+		for (int i = 0; i < (int)keys.size(); ++i)
+		{
+			auto it = m_keys_now_ptr->find(keys[i]);
+			if (it != m_keys_now_ptr->end())
+				it->second = (mask >> i) & 1;
+		}
+	}
+	else if (m_keyboard_enabled)
+	{
+		for (auto& key : *m_keys_now_ptr)
+			key.second = sf::Keyboard::isKeyPressed(key.first);
+	}
+
+	if (m_recorder)
+	{
+		sf::Uint32 mask = 0;
+		int i = 0;
+		for (auto& key : *m_keys_now_ptr)
+			mask |= sf::Uint32(key.second) << i++;
+		m_recorder->record(mask);
+	}
+}
+
+void CInputManager::setKeyboardEnabled(bool value)
+{
+	m_keyboard_enabled = value;
+}
+
+void CInputManager::setRecorder(CInputRecorder* recorder)
+{
+	m_recorder = recorder;
+}
+
+void CInputManager::setPlayer(CInputPlayer* player)
+{
+	m_player = player;
+}
+
+void CInputManager::beginSession(sf::Uint64 seed)
+{
+	if (!m_recorder)
+		return;
+
+	std::vector<sf::Keyboard::Key> keys;
+	for (auto& key : m_keys_now)
+		keys.push_back(key.first);
+	assert(keys.size() <= 32);
+	m_recorder->beginSession(seed, keys);
+}
+//-----------------------------------------------------------------------------------------------
+static const char s_input_log_magic[4] = { 'P', 'M', 'I', '1' };
+
+CInputRecorder::~CInputRecorder()
+{
+	close();
+}
+
+bool CInputRecorder::open(const std::string& file_path)
+{
+	close();
+	m_file.open(file_path, std::ios::binary | std::ios::trunc);
+	return m_file.is_open();
+}
+
+void CInputRecorder::close()
+{
+	if (m_file.is_open())
+	{
+		endSession();
+		m_file.close();
+	}
+}
+
+void CInputRecorder::beginSession(sf::Uint64 seed, const std::vector<sf::Keyboard::Key>& keys)
+{
+	if (!m_file.is_open())
+		return;
+
+	endSession();
+	m_file.write(s_input_log_magic, sizeof(s_input_log_magic));
+	writeVarint(seed);
+	writeVarint(keys.size());
+	for (auto key : keys)
+		writeVarint(key);
+
+	m_in_session = true;
+	m_mask = 0;
+	m_tick = m_last_change = 0;
+}
+
+void CInputRecorder::record(sf::Uint32 mask)
+{
+	if (!m_in_session)
+		return;
+
+	if (mask != m_mask)
+	{
+		writeVarint(m_tick - m_last_change);
+		writeVarint(mask ^ m_mask);
+		m_mask = mask;
+		m_last_change = m_tick;
+	}
+	++m_tick;
+}
+
+void CInputRecorder::endSession()
+{
+	if (!m_in_session)
+		return;
+
+	writeVarint(m_tick - m_last_change);
+	writeVarint(0);
+	m_file.flush();
+	m_in_session = false;
+}
+
+void CInputRecorder::writeVarint(sf::Uint64 value)
+{
+	char bytes[10];
+	int size = 0;
+	do
+	{
+		bytes[size] = char(value & 0x7F);
+		value >>= 7;
+		if (value)
+			bytes[size] |= 0x80;
+		++size;
+	} while (value);
+	m_file.write(bytes, size);
+}
+//-----------------------------------------------------------------------------------------------
+bool CInputPlayer::loadFromFile(const std::string& file_path)
+{
+	std::ifstream file(file_path, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	m_data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	m_sessions.clear();
+
+	// index the sessions once, playback then jumps straight to one
+	m_pos = 0;
+	while (m_pos < m_data.size())
+	{
+		std::size_t session_start = m_pos;
+		if (!readHeader())
+			return false;
+
+		sf::Uint64 delta, xor_mask;
+		do
+		{
+			if (!readVarint(delta) || !readVarint(xor_mask))
+				return false;
+		} while (xor_mask != 0);
+
+		m_sessions.push_back(session_start);
+	}
+
+	return selectSession(0);
+}
+
+int CInputPlayer::sessionsCount() const
+{
+	return (int)m_sessions.size();
+}
+
+bool CInputPlayer::selectSession(int index)
+{
+	if (index < 0 || index >= (int)m_sessions.size())
+		return false;
+
+	m_pos = m_sessions[index];
+	readHeader();
+	m_mask = 0;
+	m_tick = 0;
+	m_next_change = 0;
+	m_finished = false;
+	readRecord();
+	return true;
+}
+
+sf::Uint64 CInputPlayer::seed() const
+{
+	return m_seed;
+}
+
+const std::vector<sf::Keyboard::Key>& CInputPlayer::keys() const
+{
+	return m_keys;
+}
+
+bool CInputPlayer::next(sf::Uint32& mask)
+{
+	if (m_finished)
+	{
+		mask = m_mask;
+		return false;
+	}
+
+	if (m_tick == m_next_change)
+	{
+		if (m_pending_xor == 0)
+		{
+			m_finished = true;
+			mask = m_mask;
+			return false;
+		}
+		m_mask ^= m_pending_xor;
+		readRecord();
+	}
+
+	++m_tick;
+	mask = m_mask;
+	return true;
+}
+
+bool CInputPlayer::isFinished() const
+{
+	return m_finished;
+}
+
+bool CInputPlayer::readVarint(sf::Uint64& value)
+{
+	value = 0;
+	for (int shift = 0; m_pos < m_data.size() && shift < 64; shift += 7)
+	{
+		sf::Uint8 byte = m_data[m_pos++];
+		value |= sf::Uint64(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+			return true;
+	}
+	return false;
+}
+
+bool CInputPlayer::readHeader()
+{
+	if (m_data.size() - m_pos < sizeof(s_input_log_magic) || !std::equal(s_input_log_magic, s_input_log_magic + sizeof(s_input_log_magic), m_data.begin() + m_pos))
+		return false;
+	m_pos += sizeof(s_input_log_magic);
+
+	sf::Uint64 keys_count, key;
+	if (!readVarint(m_seed) || !readVarint(keys_count) || keys_count > 32)
+		return false;
+
+	m_keys.clear();
+	for (sf::Uint64 i = 0; i < keys_count; ++i)
+	{
+		if (!readVarint(key))
+			return false;
+		m_keys.push_back((sf::Keyboard::Key)key);
+	}
+	return true;
+}
+
+void CInputPlayer::readRecord()
+{
+	sf::Uint64 delta = 0, xor_mask = 0;
+	if (!readVarint(delta) || !readVarint(xor_mask))
+		xor_mask = 0; // truncated log: stop here
+	m_next_change = m_tick + delta;
+	m_pending_xor = (sf::Uint32)xor_mask;
 }
 //-----------------------------------------------------------------------------------------------
 const Vector& CGameObject::getPosition() const
@@ -123,7 +394,7 @@ void CGameObject::setBounds(const Rect& rect)
 }
 
 
-Vector CGameObject::getDirection()
+Vector CGameObject::getDirection() const
 {
 	return m_direction;
 }
@@ -151,16 +422,27 @@ void CGameObject::update(int delta_time)
 {
 	if (isEnabled())
 	{
-		for (auto& obj : m_objects)
-				if (!obj->m_started)
-				{
-					obj->m_started = true;
-					obj->start();
-			    }
-				
-		for (auto& obj : m_objects)
+		// by index: children added meanwhile are picked up this tick, as with the old list
+		for (std::size_t i = 0; i < m_objects.size(); ++i)
+		{
+			CGameObject* obj = m_objects[i];
+			if (!obj->m_started)
+			{
+				obj->m_started = true;
+				obj->start();
+			}
+		}
+
+		CProfiler& profiler = CProfiler::instance();
+		for (std::size_t i = 0; i < m_objects.size(); ++i)
+		{
+			CGameObject* obj = m_objects[i];
 			if (obj->isEnabled())
-				obj->update(delta_time);			 
+			{
+				CProfileScope scope(profiler, obj->getName());
+				obj->update(delta_time);
+			}
+		}
 	}
 }
 
@@ -169,15 +451,73 @@ void CGameObject::start()
 
 }
 
+// shared by all games, scenes may be built on several threads at once; created on first use,
+// as other files intern names from their static initializers
+struct NameAtoms
+{
+	std::mutex mutex;
+	std::unordered_map<std::string, int> atoms = { { std::string(), 0 } };
+};
+
+static NameAtoms& nameAtoms()
+{
+	static NameAtoms name_atoms;
+	return name_atoms;
+}
+
+int CGameObject::internName(const std::string& name)
+{
+	NameAtoms& table = nameAtoms();
+	std::lock_guard<std::mutex> lock(table.mutex);
+	auto it = table.atoms.find(name); // emplace would allocate a node even for a known name
+	if (it == table.atoms.end())
+		it = table.atoms.emplace(name, (int)table.atoms.size()).first;
+	return it->second;
+}
+
+int CGameObject::findNameAtom(const std::string& name)
+{
+	NameAtoms& table = nameAtoms();
+	std::lock_guard<std::mutex> lock(table.mutex);
+	auto it = table.atoms.find(name);
+	return it != table.atoms.end() ? it->second : -1;
+}
+
 void CGameObject::setName(const std::string& name)
 {
+	if (name == m_name)
+		return;
+
+	int old_atom = m_name_atom;
 	m_name = name;
+	m_name_atom = internName(name);
+	if (m_parent && old_atom != m_name_atom)
+	{
+		m_parent->reindexName(old_atom);
+		m_parent->reindexName(m_name_atom);
+	}
 }
 const std::string&  CGameObject::getName() const
 {
 	return m_name;
 } 
 
+int CGameObject::getNameAtom() const
+{
+	return m_name_atom;
+}
+
+void CGameObject::reindexName(int name_atom)
+{
+	for (auto obj : m_objects)
+		if (obj->m_name_atom == name_atom)
+		{
+			m_name_index[name_atom] = obj;
+			return;
+		}
+	m_name_index.erase(name_atom);
+}
+
 void CGameObject::disable()
 {
 	m_enable = false;
@@ -204,6 +544,16 @@ bool CGameObject::isVisible() const
 	return m_visible;
 }
 
+void CGameObject::setInterpolated(bool value)
+{
+	m_interpolated = value;
+}
+
+bool CGameObject::isInterpolated() const
+{
+	return m_interpolated;
+}
+
 void CGameObject::turnOn()
 {
 	show();
@@ -220,6 +570,15 @@ CGameObject* CGameObject::addObject(CGameObject* object)
 {
 	m_objects.push_back(object);
 	object->setParent(this);
+	addToIndex(object);
+	m_name_index.emplace(object->m_name_atom, object); // appended, so an earlier namesake stays first
+	if (!object->m_commands.empty())
+	{
+		// edits queued while the subtree stood alone now belong to this scene
+		for (auto& command : object->m_commands)
+			pushCommand(command.type, command.parent, command.object, command.other);
+		object->m_commands.clear();
+	}
 	if (m_started)
 	{
 		object->m_started = true;
@@ -230,12 +589,59 @@ CGameObject* CGameObject::addObject(CGameObject* object)
 
 CGameObject* CGameObject::findObjectByName(const std::string& name)
 {
-	auto it = std::find_if(m_objects.begin(), m_objects.end(), [this, &name](const CGameObject* obj) -> bool { return obj->getName() == name;  });
-	if (it != m_objects.end())
-		return *it;
+	int name_atom = findNameAtom(name);
+	return name_atom >= 0 ? findObjectByName(name_atom) : nullptr;
+}
 
- 
-	return nullptr;
+CGameObject* CGameObject::findObjectByName(int name_atom) const
+{
+	auto it = m_name_index.find(name_atom);
+	return it != m_name_index.end() ? it->second : nullptr;
+}
+
+int CGameObject::nextTypeId()
+{
+	static std::atomic<int> next_id(0);
+	int id = next_id++;
+	assert(id < MAX_TYPES);
+	return id;
+}
+
+void CGameObject::addToIndex(CGameObject* object)
+{
+	for (CGameObject* node = this; node; node = node->m_parent)
+	{
+		auto& index = node->m_type_index;
+		for (int id = 0; id < MAX_TYPES; ++id)
+		{
+			bool own = (object->m_types >> id) & 1;
+			std::size_t inner = (std::size_t)id < object->m_type_index.size() ? object->m_type_index[id].size() : 0;
+			if (!own && inner == 0)
+				continue;
+
+			if (index.size() <= (std::size_t)id)
+				index.resize(id + 1);
+			if (own)
+				index[id].push_back(object);
+			if (inner)
+				index[id].insert(index[id].end(), object->m_type_index[id].begin(), object->m_type_index[id].end());
+		}
+	}
+}
+
+void CGameObject::removeFromIndex(CGameObject* object)
+{
+	auto inside = [object](CGameObject* obj)
+	{
+		for (; obj; obj = obj->m_parent)
+			if (obj == object)
+				return true;
+		return false;
+	};
+
+	for (CGameObject* node = this; node; node = node->m_parent)
+		for (auto& objects : node->m_type_index)
+			objects.erase(std::remove_if(objects.begin(), objects.end(), inside), objects.end());
 }
 
 
@@ -249,9 +655,23 @@ CGameObject::~CGameObject()
 void CGameObject::draw(sf::RenderWindow* window)
 {
 	if (isVisible())
-		for (auto& obj : m_objects)
+	{
+		CProfiler& profiler = CProfiler::instance();
+		CSpriteBatch& batch = CSpriteBatch::instance();
+		for (std::size_t i = 0; i < m_objects.size(); ++i)
+		{
+			CGameObject* obj = m_objects[i];
 			if (obj->isVisible())
+			{
+				CProfileScope scope(profiler, obj->getName());
+				if (obj->m_interpolated)
+					batch.beginSpan(obj, sf::Vector2f(obj->m_pos.x, obj->m_pos.y));
 				obj->draw(window);
+				if (obj->m_interpolated)
+					batch.endSpan();
+			}
+		}
+	}
 }
 
 void CGameObject::postDraw(sf::RenderWindow* window)
@@ -282,75 +702,147 @@ void CGameObject::foreachObject(std::function<void(CGameObject*, bool& )> predic
 
 void CGameObject::removeObject(CGameObject* object)
 {
- 
-	  auto action = [this, object]()
-	  {
-		  auto it = std::find(m_objects.begin(), m_objects.end(), object);
-		  assert(it != m_objects.end());
-		  m_objects.erase(it);
-		  delete object;
-	  };
-	  m_preupdate_actions.push_back(action);
+	pushCommand(Command::remove, this, object);
 }
 
 void CGameObject::moveToBack()
 {
 	if (getParent())
-	{
-		auto move_to_back_action = [this]()
-		{
-			auto list = &(getParent()->m_objects);
-			auto it = std::find(list->begin(), list->end(), this);
-			assert(*it == this);
-			auto tmp = *it;
-			it = list->erase(it);
-			list->push_front(tmp);
-		};
-		m_preupdate_actions.push_back(move_to_back_action);
-	}
+		pushCommand(Command::to_back, getParent(), this);
 }
 void CGameObject::moveToFront()
 {
 	if (getParent())
-	{
-		auto move_to_front_action = [this]()
-		{
-			auto list = &(getParent()->m_objects);
-			auto it = std::find(list->begin(), list->end(), this);
-			assert(*it == this);
-			auto tmp = *it;
-			it = list->erase(it);
-			list->push_back(tmp);
-		};
-		
-		m_preupdate_actions.push_back(move_to_front_action);
-	}
+		pushCommand(Command::to_front, getParent(), this);
 }
 
 void CGameObject::moveUnderTo(CGameObject* obj)
 {
 	if (getParent())
+		pushCommand(Command::under, getParent(), this, obj);
+}
+
+CGameObject* CGameObject::root()
+{
+	CGameObject* node = this;
+	while (node->m_parent)
+		node = node->m_parent;
+	return node;
+}
+
+void CGameObject::pushCommand(Command::Type type, CGameObject* parent, CGameObject* object, CGameObject* other)
+{
+	auto& commands = root()->m_commands;
+	commands.push_back({ type, (int)commands.size(), parent, object, other });
+}
+
+void CGameObject::applyCommands()
+{
+	if (m_commands.empty())
+		return;
+
+	// group by parent, keeping the order they were issued in within a group
+	std::sort(m_commands.begin(), m_commands.end(), [](const Command& a, const Command& b)
 	{
-		auto move_under_action = [this,obj]()
+		return a.parent != b.parent ? std::less<CGameObject*>()(a.parent, b.parent) : a.order < b.order;
+	});
+
+	// objects are only detached here and deleted after every group ran, so a group whose
+	// parent was removed in the same batch still touches live memory
+	for (auto begin = m_commands.begin(); begin != m_commands.end(); )
+	{
+		auto end = begin;
+		while (end != m_commands.end() && end->parent == begin->parent)
+			++end;
+		begin->parent->applyCommands(&*begin, &*begin + (end - begin));
+		begin = end;
+	}
+	m_commands.clear();
+
+	for (auto object : m_removed)
+		delete object;
+	m_removed.clear();
+}
+
+void CGameObject::applyCommands(const Command* begin, const Command* end)
+{
+	CGameObject* root_object = root();
+	auto removed = [begin, end](const CGameObject* object)
+	{
+		for (auto command = begin; command != end; ++command)
+			if (command->type == Command::remove && command->object == object)
+				return true;
+		return false;
+	};
+
+	// all removals of the group in one pass over the children
+	std::size_t first_removed = root_object->m_removed.size();
+	auto last = std::remove_if(m_objects.begin(), m_objects.end(), [&](CGameObject* object)
+	{
+		if (!removed(object))
+			return false;
+		removeFromIndex(object);
+		root_object->m_removed.push_back(object);
+		return true;
+	});
+	m_objects.erase(last, m_objects.end());
+	for (std::size_t i = first_removed; i < root_object->m_removed.size(); ++i)
+	{
+		int name_atom = root_object->m_removed[i]->m_name_atom;
+		if (findObjectByName(name_atom) == root_object->m_removed[i])
+			reindexName(name_atom);
+	}
+
+	for (auto command = begin; command != end; ++command)
+	{
+		if (command->type == Command::remove || removed(command->object) || (command->other && removed(command->other)))
+			continue;
+
+		// a later move to either end overrides this one, unless something is placed relative to the object meanwhile
+		bool overridden = false;
+		for (auto later = command + 1; later != end && !overridden; ++later)
 		{
-			auto list = &(getParent()->m_objects);
-			auto this_obj = std::find(list->begin(), list->end(), this);
-			auto other_obj = std::find(list->begin(), list->end(), obj);
-			assert(this_obj != list->end() && other_obj != list->end());
-   
-			list->erase(this_obj);
-			list->insert(other_obj,this);
-		};
+			if (later->other == command->object)
+				break;
+			overridden = later->object == command->object && (later->type == Command::to_back || later->type == Command::to_front);
+		}
+		if (overridden)
+			continue;
 
-		m_preupdate_actions.push_back(move_under_action);
+		auto it = std::find(m_objects.begin(), m_objects.end(), command->object);
+		assert(it != m_objects.end());
+		switch (command->type)
+		{
+		case Command::to_back:
+			std::rotate(m_objects.begin(), it, it + 1);
+			break;
+		case Command::to_front:
+			std::rotate(it, it + 1, m_objects.end());
+			break;
+		case Command::under:
+		{
+			m_objects.erase(it);
+			auto other = std::find(m_objects.begin(), m_objects.end(), command->other);
+			assert(other != m_objects.end());
+			m_objects.insert(other, command->object);
+			break;
+		}
+		default:
+			break;
+		}
+		reindexName(command->object->m_name_atom);
 	}
 }
 
 void CGameObject::clear()
 {
 	for (auto object : m_objects)
+	{
+		removeFromIndex(object);
 		delete object;
+	}
 	m_objects.clear();
+	m_name_index.clear();
 }
 
 
@@ -363,77 +855,441 @@ void destroyObject(CGameObject* gameObject)
 }
 
 
-std::vector<std::function<void()>> CGameObject::m_preupdate_actions = std::vector<std::function<void()>>();
+//---------------------------------------------------------------------------------------------------------
+CTextureManager::~CTextureManager()
+{
+}
+
+void CTextureManager::loadFromFile(const std::string& name, const std::string& file_path)
+{
+	if (!CGame::isGpuless())
+		return ResourceManager<sf::Texture>::loadFromFile(name, file_path);
+
+	assert(m_resources[name] == nullptr); // allready exist
+	sf::Image image;
+	if (!image.loadFromFile(file_path))
+		throw std::runtime_error(("runtime error can't load resource: " + file_path).c_str());
+	m_stand_ins.emplace_back(new CTextureStandIn(image));
+	m_resources[name] = &m_stand_ins.back()->texture();
+}
+
+void CFontManager::loadFromFile(const std::string& name, const std::string& file_path)
+{
+	ResourceManager<sf::Font>::loadFromFile(name, file_path);
+	if (CGame::isGpuless())
+		CGlyphCache::instance().addFont(m_resources[name], file_path);
+}
+
+CGameContext::CGameContext(CTextureManager& texture_manager, CFontManager& font_manager, CSoundManager& sound_manager) :
+	m_texture_manager(texture_manager),
+	m_font_manager(font_manager),
+	m_sound_manager(sound_manager)
+{
+
+}
+
+CTextureManager&  CGameContext::textureManager()
+{
+	return m_texture_manager;
+}
+
+CFontManager&  CGameContext::fontManager()
+{
+	return m_font_manager;
+}
 
-void CGameObject::invokePreupdateActions()
+CSoundManager&  CGameContext::soundManager()
 {
-	for (auto& action : m_preupdate_actions)
-		action();
-	m_preupdate_actions.clear();
+	return m_sound_manager;
+}
+
+CEventManager&  CGameContext::eventManager()
+{
+	return m_event_manager;
+}
+
+CInputManager&  CGameContext::inputManager()
+{
+	return m_input_manager;
+}
+
+void CGameContext::playSound(const std::string& name)
+{
+	if (m_muted)
+		return;
+
+	if (m_sounds_buf.empty())
+		m_sounds_buf.resize(16);
+
+	int i = 0;
+	while (m_sounds_buf[i].getStatus() == sf::Sound::Playing)
+	{
+		if (i >= 15)
+			break;
+		++i;
+	}
+
+	m_sounds_buf[i].setBuffer(*soundManager().get(name));
+	m_sounds_buf[i].play();
+}
+
+void CGameContext::setMuted(bool muted)
+{
+	m_muted = muted;
+}
+
+bool CGameContext::isMuted() const
+{
+	return m_muted;
+}
+
+void CGameContext::setRootObject(CGameObject* root_object)
+{
+	m_root_object = root_object;
+}
+
+CGameObject* CGameContext::getRootObject()
+{
+	return m_root_object;
 }
 //---------------------------------------------------------------------------------------------------------
 void CGame::init()
 {
 
-}
- 
-CGame::~CGame()
+}
+ 
+CGame::~CGame()
+	{
+
+	}
+static bool s_gpuless = false;
+
+void CGame::setGpuless(bool value)
+{
+	s_gpuless = value;
+}
+
+bool CGame::isGpuless()
+{
+	return s_gpuless;
+}
+
+CGame::CGame(const std::string& name, const Vector& screen_size) : m_context(m_texture_manager, m_font_manager, m_sound_manager)
+	{
+		m_root_object = new CGameObject();
+		m_root_object->setName(name);
+		m_context.setRootObject(m_root_object);
+		m_screen_size = screen_size;
+		m_view = sf::View(sf::FloatRect(0, 0, screen_size.x, screen_size.y));
+	}
+
+	void CGame::setClearColor(const sf::Color& color)
+	{
+		m_clear_color = color;
+	}
+
+	const sf::Color& CGame::clearColor() const
+	{
+		return m_clear_color;
+	}
+
+	void CGame::run()
+	{
+		m_window = new sf::RenderWindow(sf::VideoMode(m_screen_size.x, m_screen_size.y), m_root_object->getName());
+		m_view = m_window->getDefaultView();
+		init();
+		m_window->setVerticalSyncEnabled(m_vsync);
+		m_pacer.setTargetRate(m_vsync ? 0 : m_frame_rate);
+
+		if (m_render_thread)
+			runThreaded();
+		else
+			runSingleThreaded();
+	}
+
+	void CGame::setRenderThread(bool value)
+	{
+		m_render_thread = value;
+	}
+
+	void CGame::processEvents()
+	{
+		CProfiler& profiler = CProfiler::instance();
+		CProfileScope scope(profiler, "events");
+		sf::Event event;
+		while (m_window->pollEvent(event))
+		{
+			if (event.type == sf::Event::EventType::Closed)
+				shutdown();
+
+			if (event.type == sf::Event::Resized)
+				m_view = sf::View(sf::FloatRect(0, 0, event.size.width, event.size.height));
+
+			if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F10)
+			{
+				m_show_draw_stats = !m_show_draw_stats;
+				m_shown_draw_calls = -1;
+				if (!m_show_draw_stats)
+					setWindowTitle(m_root_object->getName());
+			}
+			if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F11)
+				profiler.setEnabled(!profiler.isEnabled());
+			if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F12)
+				dumpProfile();
+
+			eventManager().pushEvent(event);
+		}
+	}
+
+	// F10: draw calls of the last frame and pacing of the last half second in the title bar
+	// every item of the list is one draw call when it is replayed
+	void CGame::showDrawStats(const CDisplayList& list)
 	{
+		if (!m_show_draw_stats)
+			return;
+
+		sf::Time now = m_clock.getElapsedTime();
+		bool pacing_changed = now - m_shown_pacing >= sf::milliseconds(500);
+		if (pacing_changed)
+		{
+			m_shown_pacing = now;
+			std::ostringstream text;
+			CFramePacer::writeSummary(text, m_pacer.takeRecent());
+			text << ", catch-up: " << m_catch_up.stats().triggered << ", skipped: " << m_catch_up.stats().skipped.asMilliseconds() << " ms";
+			m_pacing_text = text.str();
+		}
 
+		int draw_calls = (int)list.size();
+		if (pacing_changed || draw_calls != m_shown_draw_calls)
+		{
+			m_shown_draw_calls = draw_calls;
+			int sprites = CSpriteBatch::instance().lastFrame().sprites; // of the recording of list
+			setWindowTitle(m_root_object->getName() + " | draw calls: " + toString(draw_calls) + ", sprites: " + toString(sprites) + " | " + m_pacing_text);
+		}
 	}
-CGame::CGame(const std::string& name, const Vector& screen_size)
+
+	void CGame::setWindowTitle(const std::string& title)
 	{
-		m_root_object = new CGameObject();
-		m_root_object->setName(name);
-		m_screen_size = screen_size;
+		if (!m_rendering)
+		{
+			m_window->setTitle(title);
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(m_title_mutex);
+		m_title = title;
+		m_title_changed = true;
 	}
 
-	void CGame::setClearColor(const sf::Color& color)
+	void CGame::shutdown()
 	{
-		m_clear_color = color;
+		if (m_renderer.joinable())
+		{
+			m_rendering = false;
+			m_renderer.join();
+			m_window->setActive(true);
+		}
+
+		if (CProfiler::instance().isEnabled())
+			dumpProfile();
+		m_pacer.writeSummary(std::cout);
+		std::cout << std::endl;
+		m_catch_up.writeSummary(std::cout);
+		std::cout << std::endl;
+		m_window->close();
+		exit(0);
 	}
 
-	void CGame::run()
+	// the draw pass is recorded after the last two ticks of a frame and every frame replays the
+	// newest list with interpolated objects placed accumulator / step of the way from the older one
+	void CGame::runSingleThreaded()
 	{
-		m_window = new sf::RenderWindow(sf::VideoMode(m_screen_size.x, m_screen_size.y), m_root_object->getName());
-		init();
-
-		sf::Event event;
+		m_clock.restart();
 		sf::Clock clock;
 		sf::Time accumulator = sf::Time::Zero;
-		sf::Time ups = sf::seconds(1.f / 60.f);
-		m_window->setFramerateLimit(120);
+		sf::Time ups = m_update_step;
+		CProfiler& profiler = CProfiler::instance();
+		CDisplayList frames[2];
+		int current = 0;
+		record(frames[current]);
 
 		while (true)   // game loop
 		{
-			while (m_window->pollEvent(event))
+			CProfileScope frame_scope(profiler, "frame");
+			processEvents();
+
+			int ticks = m_catch_up.ticks(accumulator, clock.restart(), ups);
+			for (int i = 0; i < ticks; ++i)
 			{
-				if (event.type == sf::Event::EventType::Closed)
+				accumulator -= ups;
+				tick(ups);
+
+				if (i + 2 >= ticks) // older ticks of a catch-up are never shown
 				{
-					m_window->close();
-					exit(0);
+					CProfileScope scope(profiler, "record");
+					current ^= 1;
+					record(frames[current]);
 				}
+			}
 
-				if (event.type == sf::Event::Resized)
-					m_window->setView(sf::View(sf::FloatRect(0, 0, event.size.width, event.size.height)));
-
-				eventManager().pushEvent(event);
+			{
+				CProfileScope scope(profiler, "draw");
+				const CDisplayList& list = frames[current];
+				m_window->setView(list.view);
+				m_window->clear(m_clear_color);
+				list.replay(*m_window, frames[current ^ 1].spans(), std::min(1.f, accumulator / ups));
+			}
+			showDrawStats(frames[current]);
+			{
+				CProfileScope scope(profiler, "display");
+				m_window->display();
+			}
+			{
+				CProfileScope scope(profiler, "wait");
+				m_pacer.endFrame();
 			}
+		}
+	}
+
+	// this thread keeps the window's events and the fixed step simulation; after every batch of
+	// ticks the draw pass is recorded into a display list and handed to the render thread, which
+	// owns the GL context. A stalled display() only delays frames, never ticks.
+	void CGame::runThreaded()
+	{
+		sf::Time accumulator = sf::Time::Zero;
+		sf::Time ups = m_update_step;
+		CProfiler& profiler = CProfiler::instance();
+
+		// glyphs land on the font pages on first use: load them all while this is the only thread
+		// drawing, so recording texts never changes a texture the render thread has bound
+		for (CLabel* label : m_root_object->findObjectsByType<CLabel>())
+			label->loadGlyphs();
+		for (CFlowText* text : m_root_object->findObjectsByType<CFlowText>())
+			text->loadGlyphs();
+
+		m_clock.restart();
+		sf::Time last = sf::Time::Zero;
+		record(m_frames.back());
+		m_frames.publish();
+
+		m_window->setActive(false);
+		m_rendering = true;
+		m_renderer = std::thread(&CGame::renderLoop, this);
+
+		while (true)   // game loop
+		{
+			CProfileScope frame_scope(profiler, "frame");
+			processEvents();
 
-			while (accumulator > ups)
+			sf::Time now = m_clock.getElapsedTime();
+			int ticks = m_catch_up.ticks(accumulator, now - last, ups);
+			last = now;
+			for (int i = 0; i < ticks; ++i)
 			{
 				accumulator -= ups;
+				tick(ups);
+			}
+
+			if (ticks > 0)
+			{
+				CProfileScope scope(profiler, "record");
+				CDisplayList& list = m_frames.back();
+				record(list);
+				list.time = last - accumulator; // when the last tick was due
+				showDrawStats(list);
+				m_frames.publish();
+			}
+			else
+				sf::sleep(ups - accumulator);
+		}
+	}
+
+	// draws one tick behind the simulation, so there is always a newer state to move towards:
+	// alpha is how far the clock has got from the previous list's tick to the newest one's
+	void CGame::renderLoop()
+	{
+		m_window->setActive(true);
+		std::vector<CDisplayList::Span> previous;
+		sf::Time previous_time, latest_time;
+
+		while (m_rendering)
+		{
+			if (m_frames.isFresh())
+			{
+				// the list going back to the writer was the newest one: its spans are the previous
+				// tick's now, swapped out before it is recorded over (the writer clears what it gets)
+				m_frames.front().swapSpans(previous);
+				previous_time = latest_time;
+				m_frames.acquire();
+				latest_time = m_frames.front().time;
+			}
+
+			const CDisplayList& list = m_frames.front();
+			float alpha = 1;
+			if (latest_time > previous_time)
+			{
+				sf::Time shown = m_clock.getElapsedTime() - m_update_step;
+				alpha = std::max(0.f, std::min(1.f, (shown - previous_time) / (latest_time - previous_time)));
+			}
 
-				sf::sleep(sf::milliseconds(5));
-				inputManager().update(ups.asMilliseconds());
-				update(ups.asMilliseconds());
+			if (m_title_changed)
+			{
+				std::lock_guard<std::mutex> lock(m_title_mutex);
+				m_window->setTitle(m_title);
+				m_title_changed = false;
 			}
 
+			m_window->setView(list.view);
 			m_window->clear(m_clear_color);
-			draw(m_window);
-			m_window->display();
-			accumulator += clock.restart();
+			list.replay(*m_window, previous, alpha);
+			m_window->display(); // vsync or the pacer hold back this thread only
+			m_pacer.endFrame();
+		}
+
+		m_window->setActive(false);
+	}
+
+	// no window, no drawing, no sleeping: fixed steps as fast as possible;
+	// ticks <= 0 means run until stop_condition returns true
+	int CGame::runHeadless(int ticks, const std::function<bool()>& stop_condition)
+	{
+		m_headless = true;
+		m_context.setMuted(true);
+		inputManager().setKeyboardEnabled(false); // keys come from an input player, if any
+		init();
+
+		int delta_time = m_update_step.asMilliseconds();
+		int tick = 0;
+		CProfiler& profiler = CProfiler::instance();
+
+		for (; ticks <= 0 || tick < ticks; ++tick)
+		{
+			if (stop_condition && stop_condition())
+				break;
+			CProfileScope scope(profiler, "update");
+			inputManager().update(delta_time);
+			update(delta_time);
 		}
+
+		return tick;
+	}
+
+	bool CGame::isHeadless() const
+	{
+		return m_headless;
+	}
+
+	void CGame::setProfileFile(const std::string& file_path)
+	{
+		m_profile_file = file_path;
+	}
+
+	// F11 toggles the profiler of the game thread, F12 writes what it has so far
+	bool CGame::dumpProfile() const
+	{
+		bool result = CProfiler::instance().dumpToFile(m_profile_file);
+		std::cout << (result ? "profile written to " : "can't write profile to ") << m_profile_file << std::endl;
+		return result;
 	}
 
 	CGameObject*  CGame::getRootObject()
@@ -444,11 +1300,30 @@ CGame::CGame(const std::string& name, const Vector& screen_size)
 	{
 		m_root_object->draw(render_window);
 		m_root_object->postDraw(render_window);
+		CSpriteBatch::instance().endFrame();
+	}
+
+	void CGame::record(CDisplayList& list)
+	{
+		CSpriteBatch& batch = CSpriteBatch::instance();
+		batch.beginRecording(&list);
+		draw(m_window);
+		batch.endRecording();
+		list.view = m_view;
+	}
+
+	void CGame::tick(sf::Time step)
+	{
+		CProfileScope scope(CProfiler::instance(), "update");
+		sf::Clock clock;
+		inputManager().update(step.asMilliseconds());
+		update(step.asMilliseconds());
+		m_pacer.addUpdateTime(clock.getElapsedTime());
 	}
 
 	void CGame::update(int delta_time)
 	{
-		CGameObject::invokePreupdateActions(); //remove obj, change z-oreder, etc
+		m_root_object->applyCommands(); //remove obj, change z-oreder, etc
 		m_root_object->update(delta_time);
 	}
 	CTextureManager&  CGame::textureManager()
@@ -468,39 +1343,68 @@ CGame::CGame(const std::string& name, const Vector& screen_size)
 
 	CEventManager&  CGame::eventManager()
 	{
-		return m_event_manager;
+		return m_context.eventManager();
 	}
 
 	CInputManager&  CGame::inputManager()
 	{
-		return m_input_manager;
+		return m_context.inputManager();
+	}
+
+	CGameContext&  CGame::context()
+	{
+		return m_context;
 	}
 
 	void  CGame::playSound(const std::string& name)
 	{
-		int i = 0;
-		while (m_sounds_buf[i].getStatus() == sf::Sound::Playing)
-		{
-			if (i >= 16)
-				break;
-			++i;
-		}
+		m_context.playSound(name);
+	}
+
+	sf::Time  CGame::updateStep() const
+	{
+		return m_update_step;
+	}
+
+	// set before run(); interpolation keeps motion smooth at low rates
+	void CGame::setUpdateStep(sf::Time step)
+	{
+		m_update_step = step;
+	}
+
+	void CGame::setFrameRate(float hz)
+	{
+		m_frame_rate = hz;
+	}
+
+	void CGame::setVerticalSync(bool value)
+	{
+		m_vsync = value;
+	}
 
-		assert(i < 16); //sound buffer overflow
+	const CFramePacer& CGame::framePacer() const
+	{
+		return m_pacer;
+	}
 
-		m_sounds_buf[i].setBuffer(*soundManager().get(name));
-		m_sounds_buf[i].play();
+	void CGame::setCatchUp(CCatchUp::Policy policy, int max_ticks)
+	{
+		m_catch_up.setPolicy(policy, max_ticks);
 	}
 
 	Vector  CGame::screenSize() const
 	{
+		if (!m_window)
+			return m_screen_size;
 		return Vector((int)m_window->getSize().x, (int)m_window->getSize().y);
 	}
  
 //---------------------------------------------------------------------------------------------------------
 CTimer::CTimer()
 {
+	registerType<CTimer>();
 	setName("Timer");
+	m_call_back_list.reserve(16);
 }
 
 void CTimer::update(int miliseconds)
@@ -508,28 +1412,42 @@ void CTimer::update(int miliseconds)
 	if (!isEnabled())
 		return;
 
-	for (auto it = m_call_back_list.begin(); it != m_call_back_list.end(); )
+	m_in_update = true;
+	for (std::size_t i = 0; i < m_call_back_list.size(); )
 	{
-		auto& pair = *it;
-		pair.first -= sf::milliseconds(miliseconds);
+		auto& entry = m_call_back_list[i];
+		entry.time -= sf::milliseconds(miliseconds);
 
-		if (pair.first <= sf::Time() || !pair.second)
+		if (entry.time <= sf::Time() || !entry.call_back)
 		{
-			if (pair.second)
-			 pair.second.operator()();
-			it = m_call_back_list.erase(it);
+			// the call back may add new entries, so take it out of the list before the call
+			std::function<void()> call_back;
+			call_back.swap(entry.call_back);
+			m_call_back_list.erase(m_call_back_list.begin() + i);
+			if (call_back)
+				call_back();
 		}
 		else
-			++it;
+			++i;
 	}
+	m_in_update = false;
 }
 
+void CTimer::clear()
+{
+	if (!m_in_update)
+	{
+		m_call_back_list.clear();
+		return;
+	}
 
+	for (auto& entry : m_call_back_list) // erased by the running update()
+		entry.call_back = NULL;
+}
 
-void CTimer::clear()
+const std::vector<CTimer::Entry>& CTimer::entries() const
 {
-	for (auto it = m_call_back_list.begin(); it != m_call_back_list.end(); ++it)
-		(*it).second = NULL;
+	return m_call_back_list;
 }
 
 
@@ -544,6 +1462,7 @@ CTimer::~CTimer()
 
 CSpriteSheet::CSpriteSheet()
 {
+	registerType<CSpriteSheet>();
 	setName("SpriteSheet");
 	m_speed = 0.03f;
 	m_current_sprite = NULL;
@@ -553,11 +1472,20 @@ CSpriteSheet::CSpriteSheet()
 
 
 
+// the rect first: a texture that has one is not asked for its size, which a stand-in can't answer
+static sf::Sprite makeSprite(const sf::Texture& texture, const sf::IntRect& rect)
+{
+	sf::Sprite sprite;
+	sprite.setTextureRect(rect);
+	sprite.setTexture(texture);
+	return sprite;
+}
+
 void CSpriteSheet::load(const sf::Texture& texture, const std::vector<sf::IntRect>& rects)
 {
 	m_sprites.clear();
 	for (auto& rect : rects)
-		m_sprites.emplace_back(texture, rect);
+		m_sprites.push_back(makeSprite(texture, rect));
 
 	setSpriteIndex(0);
 }
@@ -567,7 +1495,7 @@ void CSpriteSheet::load(const sf::Texture& texture, const Vector& off_set, const
 	m_sprites.clear();
 	  for (int y = 0; y < rows; ++y)
 		  for (int x = 0; x < cols; ++x)
-		m_sprites.emplace_back(texture, sf::IntRect(x*abs(size.x) + off_set.x, y*abs(size.y) + off_set.y,size.x,size.y));
+		m_sprites.push_back(makeSprite(texture, sf::IntRect(x*abs(size.x) + off_set.x, y*abs(size.y) + off_set.y,size.x,size.y)));
 	
 	setSpriteIndex(0);
 	setAnimType(AnimType::forward);
@@ -647,7 +1575,7 @@ void CSpriteSheet::draw(sf::RenderWindow* wnd)
 	}
 
 
-	wnd->draw(*m_current_sprite);
+	CSpriteBatch::instance().drawSprite(wnd, *m_current_sprite);
 }
 
 void CSpriteSheet::setPosition(sf::Vector2f pos)
@@ -759,6 +1687,11 @@ AnimType CSpriteSheet::animType() const
 	return m_anim_type;
 }
 //------------------------------------------------------------------------------------------------------------------------------------------------------
+Animator::Animator()
+{
+	registerType<Animator>();
+}
+
 	 Animator::~Animator()
 	 {
 		 for (auto anim : m_animations)
@@ -876,6 +1809,7 @@ CSpriteSheet* Animator::get(const std::string& str)
 //---------------------------------------------------------------------------------------------------------
 CFlowText::CFlowText(const sf::Font& font, bool self_remove)
 {
+	registerType<CFlowText>();
 	m_text.setFont(font);
 	m_text.setFillColor(sf::Color::Black);
 	m_text.setCharacterSize(20);
@@ -934,7 +1868,7 @@ void CFlowText::draw(sf::RenderWindow* window)
 	if (m_flashing)
 	{
 		m_text.setPosition(getPosition() + m_offset);
-		window->draw(m_text);
+		CSpriteBatch::instance().draw(window, m_text.vertices(), m_text.renderStates());
 	}
 }
 
@@ -947,13 +1881,253 @@ void CFlowText::setTextSize(int size)
 	m_text.setCharacterSize(size);
 }
 
+void CFlowText::loadGlyphs() const
+{
+	m_text.loadGlyphs();
+}
+
+//---------------------------------------------------------------------------------------------------------
+char* appendInt(char* out, int value)
+{
+	unsigned int magnitude = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+	if (value < 0)
+		*out++ = '-';
+
+	char digits[10];
+	int count = 0;
+	do
+	{
+		digits[count++] = char('0' + magnitude % 10);
+		magnitude /= 10;
+	} while (magnitude);
+
+	while (count)
+		*out++ = digits[--count];
+	return out;
+}
+
+void CRetainedText::setString(const std::string& str)
+{
+	if (str != m_string)
+	{
+		m_string = str;
+		m_layout_dirty = true;
+	}
+}
+
+void CRetainedText::setString(const char* str)
+{
+	if (m_string.compare(str) != 0)
+	{
+		m_string = str; // reuses the capacity, so HUD counters don't allocate
+		m_layout_dirty = true;
+	}
+}
+
+const std::string& CRetainedText::getString() const
+{
+	return m_string;
+}
+
+void CRetainedText::setFont(const sf::Font& font)
+{
+	if (m_font != &font)
+	{
+		m_font = &font;
+		m_layout_dirty = true;
+	}
+}
+
+const sf::Font* CRetainedText::getFont() const
+{
+	return m_font;
+}
+
+void CRetainedText::setCharacterSize(unsigned int size)
+{
+	if (m_size != size)
+	{
+		m_size = size;
+		m_layout_dirty = true;
+	}
+}
+
+void CRetainedText::setStyle(sf::Uint32 style)
+{
+	if (m_style != style)
+	{
+		m_style = style;
+		m_layout_dirty = true;
+	}
+}
+
+void CRetainedText::setFillColor(const sf::Color& color)
+{
+	if (m_color != color)
+	{
+		m_color = color;
+		m_color_dirty = true;
+	}
+}
+
+const sf::Color& CRetainedText::getFillColor() const
+{
+	return m_color;
+}
+
+sf::FloatRect CRetainedText::getLocalBounds() const
+{
+	ensureLayout();
+	return m_bounds;
+}
+
+sf::FloatRect CRetainedText::getGlobalBounds() const
+{
+	return getTransform().transformRect(getLocalBounds());
+}
+
+const sf::VertexArray& CRetainedText::vertices() const
+{
+	ensureLayout();
+	return m_vertices;
+}
+
+sf::RenderStates CRetainedText::renderStates() const
+{
+	sf::RenderStates states(getTransform());
+	if (m_font)
+		states.texture = &texture();
+	return states;
+}
+
+void CRetainedText::draw(sf::RenderTarget& target, sf::RenderStates states) const
+{
+	if (!m_font)
+		return;
+
+	ensureLayout();
+	states.transform.combine(getTransform());
+	states.texture = &texture();
+	target.draw(m_vertices, states);
+}
+
+const sf::Texture& CRetainedText::texture() const
+{
+	if (CGame::isGpuless())
+		return CGlyphCache::instance().texture(m_font, m_size, (m_style & sf::Text::Bold) != 0);
+	return m_font->getTexture(m_size);
+}
+
+const sf::Glyph& CRetainedText::glyph(sf::Uint32 code, bool bold) const
+{
+	if (CGame::isGpuless())
+		return CGlyphCache::instance().glyph(m_font, code, m_size, bold);
+	return m_font->getGlyph(code, m_size, bold);
+}
+
+void CRetainedText::loadGlyphs() const
+{
+	if (!m_font || CGame::isGpuless()) // the cache makes whole pages
+		return;
+
+	bool bold = (m_style & sf::Text::Bold) != 0;
+	for (sf::Uint32 code = ' '; code <= '~'; ++code)
+		m_font->getGlyph(code, m_size, bold);
+}
+
+// the layout of sf::Text (regular and bold only), done once per change instead of on demand
+void CRetainedText::ensureLayout() const
+{
+	if (m_font && !CGame::isGpuless() && m_font->getTexture(m_size).getSize() != m_texture_size)
+		m_layout_dirty = true;
+
+	if (!m_layout_dirty)
+	{
+		if (m_color_dirty)
+			for (std::size_t i = 0; i < m_vertices.getVertexCount(); ++i)
+				m_vertices[i].color = m_color;
+		m_color_dirty = false;
+		return;
+	}
+
+	m_layout_dirty = m_color_dirty = false;
+	m_vertices.clear();
+	m_vertices.setPrimitiveType(sf::Triangles);
+	m_bounds = sf::FloatRect();
+	if (!m_font || m_string.empty())
+		return;
+
+	bool bold = (m_style & sf::Text::Bold) != 0;
+	float whitespace = glyph(L' ', bold).advance;
+	float line_spacing = m_font->getLineSpacing(m_size);
+	float x = 0, y = (float)m_size;
+	float min_x = (float)m_size, min_y = (float)m_size, max_x = 0, max_y = 0;
+	sf::Uint32 previous = 0;
+
+	for (char c : m_string)
+	{
+		sf::Uint32 code = (unsigned char)c;
+		if (code == '\r')
+			continue;
+
+		x += m_font->getKerning(previous, code, m_size);
+		previous = code;
+
+		if (code == ' ' || code == '\n' || code == '\t')
+		{
+			min_x = std::min(min_x, x);
+			min_y = std::min(min_y, y);
+			if (code == ' ')
+				x += whitespace;
+			else if (code == '\t')
+				x += whitespace * 4;
+			else
+			{
+				y += line_spacing;
+				x = 0;
+			}
+			max_x = std::max(max_x, x);
+			max_y = std::max(max_y, y);
+			continue;
+		}
+
+		const sf::Glyph& glyph = this->glyph(code, bold);
+		const float padding = 1.0f;
+		float left = glyph.bounds.left - padding, top = glyph.bounds.top - padding;
+		float right = glyph.bounds.left + glyph.bounds.width + padding, bottom = glyph.bounds.top + glyph.bounds.height + padding;
+		float u1 = glyph.textureRect.left - padding, v1 = glyph.textureRect.top - padding;
+		float u2 = glyph.textureRect.left + glyph.textureRect.width + padding, v2 = glyph.textureRect.top + glyph.textureRect.height + padding;
+
+		m_vertices.append(sf::Vertex(sf::Vector2f(x + left, y + top), m_color, sf::Vector2f(u1, v1)));
+		m_vertices.append(sf::Vertex(sf::Vector2f(x + right, y + top), m_color, sf::Vector2f(u2, v1)));
+		m_vertices.append(sf::Vertex(sf::Vector2f(x + left, y + bottom), m_color, sf::Vector2f(u1, v2)));
+		m_vertices.append(sf::Vertex(sf::Vector2f(x + left, y + bottom), m_color, sf::Vector2f(u1, v2)));
+		m_vertices.append(sf::Vertex(sf::Vector2f(x + right, y + top), m_color, sf::Vector2f(u2, v1)));
+		m_vertices.append(sf::Vertex(sf::Vector2f(x + right, y + bottom), m_color, sf::Vector2f(u2, v2)));
+
+		min_x = std::min(min_x, x + glyph.bounds.left);
+		max_x = std::max(max_x, x + glyph.bounds.left + glyph.bounds.width);
+		min_y = std::min(min_y, y + glyph.bounds.top);
+		max_y = std::max(max_y, y + glyph.bounds.top + glyph.bounds.height);
+		x += glyph.advance;
+	}
+
+	m_bounds = sf::FloatRect(min_x, min_y, max_x - min_x, max_y - min_y);
+	if (CGame::isGpuless())
+		return;
+	m_texture_size = m_font->getTexture(m_size).getSize();
+	CSoftwareRenderer::textureChanged(&m_font->getTexture(m_size)); // new glyphs may have been added
+}
+
 //---------------------------------------------------------------------------------------------------------
 CLabel::CLabel()
 {
+	registerType<CLabel>();
 	init();
 }
 CLabel::CLabel(const std::string& str)
 {
+	registerType<CLabel>();
 	init();
 	setString(str);
 }
@@ -1005,6 +2179,10 @@ void CLabel::setString(const std::string& str)
 {
 	m_text.setString(str);
 }
+void CLabel::setString(const char* str)
+{
+	m_text.setString(str);
+}
 void CLabel::setOutlineColor(const sf::Color& color)
 {
 	m_shape.setOutlineColor(color);
@@ -1021,25 +2199,33 @@ bool CLabel::contains(const Vector& point) const
 {
 	return m_rect.isContain(point);
 }
+void CLabel::loadGlyphs() const
+{
+	m_text.loadGlyphs();
+}
 void CLabel::draw(sf::RenderWindow* window)
 {
-	window->draw(m_shape);
+	CSpriteBatch& batch = CSpriteBatch::instance();
+	batch.draw(window, m_shape);
 
 	if (m_sprite.getTexture())
 	{
 		m_sprite.setPosition(getPosition());
-		window->draw(m_sprite);
+		batch.drawSprite(window, m_sprite);
 	}
 
-	if (!m_text.getString().isEmpty())
+	if (!m_text.getString().empty())
 	{
 		if (m_text_align == center)
-			m_text.setPosition(getPosition() + m_rect.size() / 2 - Vector(m_text.getGlobalBounds().width, m_text.getGlobalBounds().height) / 2);
+		{
+			sf::FloatRect bounds = m_text.getLocalBounds(); // cached, so centring costs no layout
+			m_text.setPosition(getPosition() + m_rect.size() / 2 - Vector(bounds.width, bounds.height) / 2);
+		}
 		else if (m_text_align == left)
 			m_text.setPosition(getPosition().x, getPosition().y);
 
 
-		window->draw(m_text);
+		batch.draw(window, m_text.vertices(), m_text.renderStates());
 	}
 }
 Rect CLabel::getBounds() const
@@ -1063,9 +2249,30 @@ CLabel* CLabel::clone() const
 	return new_label;
 }
 //-------------------------------------------------------------------------------------------------------
-CGameObject* WaypointSystem::getObject()
+WaypointSystem::WaypointSystem()
 {
+	registerType<WaypointSystem>();
 	setName("WaypointSystem");
+	m_path.reserve(MAX_SAVED_PATH);
+}
+
+void WaypointSystem::saveState(State& state) const
+{
+	state.size = (int)std::min(m_path.size(), (std::size_t)MAX_SAVED_PATH); // addPath keeps it in bounds
+	std::copy(m_path.begin(), m_path.begin() + state.size, state.path);
+	state.length = m_length;
+	state.speed = m_speed;
+}
+
+void WaypointSystem::restoreState(const State& state)
+{
+	m_path.assign(state.path, state.path + state.size);
+	m_length = state.length;
+	m_speed = state.speed;
+}
+
+CGameObject* WaypointSystem::getObject()
+{
 	return getParent();
 }
 void WaypointSystem::addPath(const std::vector<Vector>& path, float speed, bool align)
@@ -1076,7 +2283,17 @@ void WaypointSystem::addPath(const std::vector<Vector>& path, float speed, bool
 	m_length = 0;
 	if (align)
 		m_path.insert(m_path.begin(), getObject()->getPosition());
+	if (m_path.size() > MAX_SAVED_PATH)
+	{
+		std::cout << getObject()->getName() << ": path of " << m_path.size() << " points cut to " << MAX_SAVED_PATH << std::endl;
+		m_path.resize(MAX_SAVED_PATH);
+	}
+}
+void WaypointSystem::setWrapArea(const Rect& area)
+{
+	m_wrap_area = area;
 }
+
 bool WaypointSystem::isMoving() const
 {
 	return !m_path.empty();
@@ -1094,6 +2311,18 @@ void WaypointSystem::update(int delta_time)
 		m_length += delta_time*m_speed;
 		Vector current_pos = Vector::moveTowards(m_path[0], m_path[1], m_length);
 		getObject()->setDirection((m_path[1] - m_path[0]).normalized());
+
+		Vector shift;
+		if (m_wrap_area.width() > 0)
+			shift.x = current_pos.x < m_wrap_area.left() ? m_wrap_area.width() : current_pos.x >= m_wrap_area.right() ? -m_wrap_area.width() : 0;
+		if (m_wrap_area.height() > 0)
+			shift.y = current_pos.y < m_wrap_area.top() ? m_wrap_area.height() : current_pos.y >= m_wrap_area.bottom() ? -m_wrap_area.height() : 0;
+		if (shift != Vector::zero)
+		{
+			current_pos += shift;
+			for (auto& point : m_path)
+				point += shift;
+		}
 		getObject()->setPosition(current_pos);
 		if (m_length > max_length)
 		{
@@ -8,12 +8,19 @@
 #include <functional>
 #include <vector>
 #include <list>
+#include <algorithm>
 #include <unordered_map>
 #include <fstream>
 #include "assert.h"
 #include <iostream>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <memory>
 #include "Geometry.h"
 #include "TileMap.h"
+#include "SpriteBatch.h"
+#include "FramePacer.h"
 
 template <typename T>
 std::string toString(const T& param)
@@ -23,57 +30,151 @@ std::string toString(const T& param)
     return sstream.str();
 }
 
+// xoshiro128** generator: tiny, fast and fully defined by its seed, so every game owns
+// one and runs are reproducible regardless of what other games or threads do
+class CRandom
+{
+public:
+	CRandom(sf::Uint64 seed = 0)
+	{
+		setSeed(seed);
+	}
+
+	void setSeed(sf::Uint64 seed)
+	{
+		for (auto& word : m_state) // splitmix64 expansion of the seed
+		{
+			seed += 0x9E3779B97F4A7C15ull;
+			sf::Uint64 z = seed;
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+			word = sf::Uint32((z ^ (z >> 31)) >> 32);
+		}
+	}
+
+	sf::Uint32 next()
+	{
+		sf::Uint32 result = rotl(m_state[1] * 5, 7) * 9;
+		sf::Uint32 t = m_state[1] << 9;
+		m_state[2] ^= m_state[0];
+		m_state[3] ^= m_state[1];
+		m_state[1] ^= m_state[2];
+		m_state[0] ^= m_state[3];
+		m_state[2] ^= t;
+		m_state[3] = rotl(m_state[3], 11);
+		return result;
+	}
+
+	// uniform in [0, bound)
+	int nextInt(int bound)
+	{
+		return int((sf::Uint64(next()) * sf::Uint32(bound)) >> 32);
+	}
+
+	void getState(sf::Uint32 state[4]) const
+	{
+		std::copy(m_state, m_state + 4, state);
+	}
+
+	void setState(const sf::Uint32 state[4])
+	{
+		std::copy(state, state + 4, m_state);
+	}
+
+private:
+	static sf::Uint32 rotl(sf::Uint32 value, int shift)
+	{
+		return (value << shift) | (value >> (32 - shift));
+	}
+	sf::Uint32 m_state[4];
+};
+
 class CGameObject
 {
 public:
 	CGameObject();
 	virtual ~CGameObject();
+	// names are interned to integer atoms, so lookups hash an int instead of comparing strings
+	static int internName(const std::string& name);
 	void setName(const std::string& name);
 	const std::string& getName() const;
+	int getNameAtom() const;
 	void setParent(CGameObject* game_object);
 	CGameObject* getParent() const;
 	CGameObject* addObject(CGameObject* object);
 	CGameObject* findObjectByName(const std::string& name);
+	CGameObject* findObjectByName(int name_atom) const;
 	void moveToBack();
 	void moveToFront();
 	void moveUnderTo(CGameObject* obj);
-    template <typename T>
-    T* findObjectByName(const std::string& name)
-    {
-        auto it = std::find_if(m_objects.begin(), m_objects.end(), [this, &name](const CGameObject* obj) -> bool { return obj->getName() == name;  });
-        if (it != m_objects.end())
-            return dynamic_cast<T*>(*it);
-
-        return nullptr;
-    }
-    template <typename T>
-    T* findObjectByType()
-    {
-        for (auto& obj : m_objects)
-            if (dynamic_cast<T*>(obj) != nullptr)
-                return (T*)obj;
-        return nullptr;
-    }
-    template <typename T>
-    std::vector<T*> findObjectsByType()
-    {
-        std::vector<T*> objects;
-        for (auto& obj : m_objects)
-        {
-            if (dynamic_cast<T*>(obj) != nullptr)
-                objects.push_back((T*)obj);
-
-            auto objects_temp = obj->findObjectsByType<T>();
-            if (!objects_temp.empty())
-                objects.insert(objects.end(), objects_temp.begin(), objects_temp.end());
-        }
-        return objects;
-    }
+	// typed view over one type list of the index below, valid until the tree changes
+	template <typename T>
+	class ObjectsView
+	{
+	public:
+		class iterator
+		{
+		public:
+			iterator(CGameObject* const* ptr) : m_ptr(ptr) {}
+			T* operator*() const { return static_cast<T*>(*m_ptr); }
+			iterator& operator++() { ++m_ptr; return *this; }
+			bool operator!=(const iterator& other) const { return m_ptr != other.m_ptr; }
+		private:
+			CGameObject* const* m_ptr;
+		};
+		ObjectsView(const std::vector<CGameObject*>& objects) : m_objects(objects) {}
+		iterator begin() const { return iterator(m_objects.data()); }
+		iterator end() const { return iterator(m_objects.data() + m_objects.size()); }
+		std::size_t size() const { return m_objects.size(); }
+		bool empty() const { return m_objects.empty(); }
+		T* operator[](std::size_t index) const { return static_cast<T*>(m_objects[index]); }
+	private:
+		const std::vector<CGameObject*>& m_objects;
+	};
+	template <typename T>
+	static int typeId()
+	{
+		static const int id = nextTypeId();
+		return id;
+	}
+	template <typename T>
+	bool isType() const
+	{
+		return (m_types & (sf::Uint64(1) << typeId<T>())) != 0;
+	}
+	template <typename T>
+	T* findObjectByName(const std::string& name)
+	{
+		CGameObject* obj = findObjectByName(name);
+		return obj && obj->isType<T>() ? static_cast<T*>(obj) : nullptr;
+	}
+	template <typename T>
+	T* findObjectByName(int name_atom) const
+	{
+		CGameObject* obj = findObjectByName(name_atom);
+		return obj && obj->isType<T>() ? static_cast<T*>(obj) : nullptr;
+	}
+	template <typename T>
+	T* findObjectByType()
+	{
+		for (auto obj : m_objects)
+			if (obj->isType<T>())
+				return static_cast<T*>(obj);
+		return nullptr;
+	}
+	// every object of type T in the subtree, in the order they were added
+	template <typename T>
+	ObjectsView<T> findObjectsByType() const
+	{
+		static const std::vector<CGameObject*> empty;
+		std::size_t id = typeId<T>();
+		return ObjectsView<T>(id < m_type_index.size() ? m_type_index[id] : empty);
+	}
 	void foreachObject(std::function<void(CGameObject*)> predicate);
 	void foreachObject(std::function<void(CGameObject*, bool& need_break)> predicate);
 	void removeObject(CGameObject* obj);
 	void clear();
-	static void invokePreupdateActions();
+	void applyCommands(); // call on the root before its update: removals and z-order changes
 	virtual void start();
 	virtual void update(int delta_time);
 	virtual void events(const sf::Event& event) {};
@@ -83,6 +184,9 @@ public:
 	void hide();
 	void show();
 	bool isVisible() const;
+	// drawn between its positions of the last two ticks when the display outpaces the simulation
+	void setInterpolated(bool value);
+	bool isInterpolated() const;
 	void turnOn();
 	void turnOff();
 	virtual void draw(sf::RenderWindow* window);
@@ -92,19 +196,53 @@ public:
 	void setPosition(float x, float y);
 	void move(const Vector& point);
 	void setDirection(const Vector& direction);
-	Vector getDirection();
+	Vector getDirection() const;
 	virtual Rect getBounds() const;
 	virtual void setBounds(const Rect& rect);
 	void setSize(const Vector& size);
+protected:
+	// subclasses register themselves (and so every base they want to be found by) in their constructors
+	template <typename T>
+	void registerType()
+	{
+		assert(!m_parent);
+		m_types |= sf::Uint64(1) << typeId<T>();
+	}
 private:
+	// tree edits are deferred, so objects can remove or reorder themselves during update
+	struct Command
+	{
+		enum Type { remove, to_back, to_front, under };
+		Type type;
+		int order;
+		CGameObject* parent;
+		CGameObject* object;
+		CGameObject* other;
+	};
+	enum { MAX_TYPES = 64 };
+	CGameObject* root();
+	void pushCommand(Command::Type type, CGameObject* parent, CGameObject* object, CGameObject* other = nullptr);
+	void applyCommands(const Command* begin, const Command* end);
+	static int nextTypeId();
+	// atom of an interned name, -1 for a name nothing was ever called
+	static int findNameAtom(const std::string& name);
+	void addToIndex(CGameObject* object);
+	void removeFromIndex(CGameObject* object);
+	void reindexName(int name_atom);
 	std::string m_name;
+	int m_name_atom = 0;
+	std::unordered_map<int, CGameObject*> m_name_index; // name atom -> first child with that name
 	bool m_started = false;
-	static std::vector<std::function<void()>> m_preupdate_actions;
 	CGameObject* m_parent;
-	std::list<CGameObject*> m_objects;
+	std::vector<CGameObject*> m_objects;
+	sf::Uint64 m_types = 0;
+	std::vector<std::vector<CGameObject*>> m_type_index; // type id -> objects of the whole subtree
+	std::vector<Command> m_commands; // only the root's queue is used, one per scene
+	std::vector<CGameObject*> m_removed;
 	Vector m_direction;
 	bool m_enable;
 	bool m_visible;
+	bool m_interpolated = false;
 	Vector m_pos, m_size;
 };
 
@@ -148,8 +286,9 @@ void ResourceManager<T>::loadFromFile(const std::string& name, const std::string
 template <typename T>
 T* ResourceManager<T>::get(const std::string& name)
 {
-	assert(m_resources[name] != nullptr); //no such resource
-	return m_resources[name];
+	auto it = m_resources.find(name); // no insertion: shared between simulation threads
+	assert(it != m_resources.end() && it->second != nullptr); //no such resource
+	return it->second;
 }
 
 template <typename T>
@@ -161,8 +300,9 @@ T* ResourceManager<T>::operator[](const std::string& name)
 template <typename T>
 const T* ResourceManager<T>::get(const std::string& name) const
 {
-	assert(m_resources[name] != nullptr); //no such resource
-	return m_resources[name];
+	auto it = m_resources.find(name);
+	assert(it != m_resources.end() && it->second != nullptr); //no such resource
+	return it->second;
 }
 
 template <typename T>
@@ -177,11 +317,62 @@ ResourceManager<T>::~ResourceManager()
 		}
 }
 
+// Binary log of the registered keys, one state per input tick. A file holds sessions
+// one after another: header (magic, seed, key codes), then a record per change of the
+// key mask: varint ticks since the previous change, varint xor with the previous mask.
+// A record with a zero xor ends the session, so held keys cost nothing.
+class CInputRecorder
+{
+public:
+	~CInputRecorder();
+	bool open(const std::string& file_path);
+	void close();
+	void beginSession(sf::Uint64 seed, const std::vector<sf::Keyboard::Key>& keys);
+	void record(sf::Uint32 mask);
+private:
+	void endSession();
+	void writeVarint(sf::Uint64 value);
+	std::ofstream m_file;
+	bool m_in_session = false;
+	sf::Uint32 m_mask = 0;
+	sf::Uint64 m_tick = 0;
+	sf::Uint64 m_last_change = 0;
+};
+
+class CInputPlayer
+{
+public:
+	bool loadFromFile(const std::string& file_path);
+	int sessionsCount() const;
+	bool selectSession(int index);
+	sf::Uint64 seed() const;
+	const std::vector<sf::Keyboard::Key>& keys() const;
+	bool next(sf::Uint32& mask); // false once the session is over
+	bool isFinished() const;
+private:
+	bool readVarint(sf::Uint64& value);
+	bool readHeader();
+	void readRecord();
+	std::vector<sf::Uint8> m_data;
+	std::vector<std::size_t> m_sessions;
+	std::size_t m_pos = 0;
+	sf::Uint64 m_seed = 0;
+	std::vector<sf::Keyboard::Key> m_keys;
+	sf::Uint32 m_mask = 0;
+	sf::Uint32 m_pending_xor = 0;
+	sf::Uint64 m_tick = 0;
+	sf::Uint64 m_next_change = 0;
+	bool m_finished = true;
+};
+
 class CInputManager
 {
 private:
 	std::map<sf::Keyboard::Key, bool> m_keys_prev, *m_keys_prev_ptr;
 	std::map<sf::Keyboard::Key, bool> m_keys_now, *m_keys_now_ptr;
+	CInputRecorder* m_recorder = NULL;
+	CInputPlayer* m_player = NULL;
+	bool m_keyboard_enabled = true;
 public:
 	CInputManager();
 	void registerKey(const sf::Keyboard::Key& key);
@@ -190,12 +381,106 @@ public:
 	bool isKeyJustReleased(const sf::Keyboard::Key& key);
 	bool isKeyPressed(const sf::Keyboard::Key& key);
 	void update(int delta_time);
+	void setKeyboardEnabled(bool value);
+	void setRecorder(CInputRecorder* recorder);
+	void setPlayer(CInputPlayer* player);
+	void beginSession(sf::Uint64 seed);
+};
+
+class CTextureStandIn;
+
+// without a GPU (CGame::isGpuless) textures are CTextureStandIns around their images
+class CTextureManager : public ResourceManager<sf::Texture>
+{
+public:
+	~CTextureManager();
+	void loadFromFile(const std::string& name, const std::string& file_path) override;
+private:
+	std::vector<std::unique_ptr<CTextureStandIn>> m_stand_ins;
+};
+
+// without a GPU the glyphs come from CGlyphCache, which reads the font file again
+class CFontManager : public ResourceManager<sf::Font>
+{
+public:
+	void loadFromFile(const std::string& name, const std::string& file_path) override;
 };
 
-using CTextureManager = ResourceManager<sf::Texture>;
-using CFontManager = ResourceManager<sf::Font>;
 using CSoundManager = ResourceManager<sf::SoundBuffer>;
 
+// Everything a scene needs from the running game. Resources are shared (read-only once
+// loaded), events, input and sound channels belong to one game instance.
+class CGameContext
+{
+public:
+	CGameContext(CTextureManager& texture_manager, CFontManager& font_manager, CSoundManager& sound_manager);
+	CGameContext(const CGameContext&) = delete;
+	CGameContext& operator=(const CGameContext&) = delete;
+	CTextureManager&  textureManager();
+	CFontManager&  fontManager();
+	CSoundManager&  soundManager();
+	CEventManager&  eventManager();
+	CInputManager&  inputManager();
+	void playSound(const std::string& name);
+	void setMuted(bool muted);
+	bool isMuted() const;
+	void setRootObject(CGameObject* root_object);
+	CGameObject* getRootObject();
+private:
+	CTextureManager& m_texture_manager;
+	CFontManager& m_font_manager;
+	CSoundManager& m_sound_manager;
+	CEventManager m_event_manager;
+	CInputManager m_input_manager;
+	std::vector<sf::Sound> m_sounds_buf; // created on first sound, muted contexts never own one
+	CGameObject* m_root_object = NULL;
+	bool m_muted = false;
+};
+
+// Lock-free hand-over between one writer and one reader: the writer fills back() and publishes
+// it, the reader takes the newest published slot. Neither side ever waits for the other.
+template <typename T>
+class CTripleBuffer
+{
+public:
+	T& back()
+	{
+		return m_slots[m_back];
+	}
+	void publish()
+	{
+		m_back = m_ready.exchange(m_back | FRESH) & INDEX;
+	}
+	// something newer than front() was published (only acquire() takes it back)
+	bool isFresh() const
+	{
+		return (m_ready.load() & FRESH) != 0;
+	}
+	// true if something newer than front() was published; front() is then that slot
+	bool acquire()
+	{
+		if (!isFresh())
+			return false;
+		m_front = m_ready.exchange(m_front) & INDEX;
+		return true;
+	}
+	// the reader may take things out of its slot before acquire() hands it back to the writer
+	T& front()
+	{
+		return m_slots[m_front];
+	}
+	const T& front() const
+	{
+		return m_slots[m_front];
+	}
+private:
+	enum { INDEX = 3, FRESH = 4 };
+	T m_slots[3];
+	int m_back = 0;
+	int m_front = 1;
+	std::atomic<int> m_ready{ 2 };
+};
+
 class CGame
 {
 private:
@@ -203,13 +488,40 @@ private:
 	CTextureManager m_texture_manager;
 	CFontManager m_font_manager;
 	CSoundManager m_sound_manager;
-	CEventManager m_event_manager;
-	CInputManager m_input_manager;
-	sf::Sound m_sounds_buf[32];
+	CGameContext m_context;
 	sf::RenderWindow* m_window = NULL; 
 	Vector m_screen_size;
 	sf::Color m_clear_color = sf::Color::Black;
+	sf::Time m_update_step = sf::seconds(1.f / 60.f);
+	bool m_headless = false;
+	std::string m_profile_file = "profile.json";
+	bool m_show_draw_stats = false;
+	int m_shown_draw_calls = -1;
+	sf::Time m_shown_pacing;
+	std::string m_pacing_text;
+	CFramePacer m_pacer;
+	CCatchUp m_catch_up;
+	float m_frame_rate = 120;
+	bool m_vsync = false;
+	sf::View m_view;
+	sf::Clock m_clock;
+	// render thread: the simulation records a display list per tick, the renderer replays the newest
+	bool m_render_thread = true;
+	std::atomic<bool> m_rendering{ false };
+	std::thread m_renderer;
+	std::mutex m_title_mutex;       // the window belongs to the render thread while it runs:
+	std::string m_title;            // titles are left here for it to set
+	std::atomic<bool> m_title_changed{ false };
+	CTripleBuffer<CDisplayList> m_frames;
 	void  draw(sf::RenderWindow* render_window);
+	void processEvents();
+	void showDrawStats(const CDisplayList& list);
+	void setWindowTitle(const std::string& title);
+	void tick(sf::Time step);
+	void runSingleThreaded();
+	void runThreaded();
+	void renderLoop();
+	void shutdown();
 protected:
 	void virtual init();
 	void virtual update(int delta_time);
@@ -217,32 +529,63 @@ protected:
 public:
 	CGame(const std::string& name, const Vector& screen_size);
 	~CGame();
+	// set before the game is created, for runs that never open a window: no GL object is made,
+	// textures stay images for CSoftwareRenderer and text is rasterized by CGlyphCache
+	static void setGpuless(bool value);
+	static bool isGpuless();
 	void run();
+	void setRenderThread(bool value);
+	int runHeadless(int ticks, const std::function<bool()>& stop_condition = nullptr);
+	bool isHeadless() const;
+	void setProfileFile(const std::string& file_path);
+	bool dumpProfile() const;
 	CGameObject*  getRootObject();
 	CTextureManager&  textureManager();
 	CFontManager&  fontManager();
 	CSoundManager&  soundManager();
 	CEventManager&  eventManager();
 	CInputManager&  inputManager();
+	CGameContext&  context();
 	void playSound(const std::string& name);
 	Vector screenSize() const;
+	sf::Time updateStep() const;
+	void setUpdateStep(sf::Time step);
+	// set before run(); 0 draws as fast as possible, vsync leaves the pacing to the display
+	void setFrameRate(float hz);
+	void setVerticalSync(bool value);
+	const CFramePacer& framePacer() const;
+	// set before run(); how far the update loop may fall behind, see CCatchUp
+	void setCatchUp(CCatchUp::Policy policy, int max_ticks);
+	// the draw pass of the current state, also works headless
+	void record(CDisplayList& list);
+	const sf::Color& clearColor() const;
 };
 
 class CTimer : public CGameObject
 {
 public:
+	// event/arg are optional tags, so the owner can save pending calls and schedule them again
+	struct Entry
+	{
+		sf::Time time;
+		std::function<void()> call_back;
+		int event;
+		int arg;
+	};
 	CTimer();
 	void update(int delta_time) override;
 	void clear();
 	template <typename T>
-	void add(sf::Time time, T callable)
+	void add(sf::Time time, T callable, int event = -1, int arg = 0)
 	{
-		m_call_back_list.push_back(std::pair<sf::Time, std::function<void()>>(time, std::bind(callable)));
+		m_call_back_list.push_back(Entry{ time, std::function<void()>(callable), event, arg });
 	}
+	const std::vector<Entry>& entries() const;
 	~CTimer();
 
 private:
-	std::list< std::pair<sf::Time, std::function<void()>>> m_call_back_list;
+	std::vector<Entry> m_call_back_list;
+	bool m_in_update = false;
 };
 
 enum class AnimType { manual, forward, forward_stop, forward_cycle, forward_backward_cycle };
@@ -287,6 +630,7 @@ private:
 class Animator : public CGameObject
 {
 public:
+	Animator();
 	~Animator();
 	void create(const std::string& name, const sf::Texture& texture, const Vector& off_set, const Vector& size, int cols, int rows, float speed, AnimType anim_type = AnimType::forward_cycle);
 	void create(const std::string& name, const sf::Texture& texture, const Rect& rect);
@@ -308,6 +652,49 @@ private:
 	bool m_flipped = false;
 };
 
+// writes value in decimal at out, no locale, no allocation; returns the end of the digits
+char* appendInt(char* out, int value);
+
+// sf::Text look-alike that keeps its glyph quads and bounds: layout runs only when the string,
+// font, size or style change, and a colour change just repaints the vertices
+class CRetainedText : public sf::Drawable, public sf::Transformable
+{
+public:
+	void setString(const std::string& str);
+	void setString(const char* str);
+	const std::string& getString() const;
+	void setFont(const sf::Font& font);
+	const sf::Font* getFont() const;
+	void setCharacterSize(unsigned int size);
+	void setStyle(sf::Uint32 style);
+	void setFillColor(const sf::Color& color);
+	const sf::Color& getFillColor() const;
+	sf::FloatRect getLocalBounds() const;
+	sf::FloatRect getGlobalBounds() const;
+	// puts every printable ASCII glyph of the font, size and style on the font's page now: layouts
+	// after that only look glyphs up and never touch the texture
+	void loadGlyphs() const;
+	// what draw() submits, for callers that batch or record draws themselves
+	const sf::VertexArray& vertices() const;
+	sf::RenderStates renderStates() const;
+protected:
+	void draw(sf::RenderTarget& target, sf::RenderStates states) const override;
+private:
+	void ensureLayout() const;
+	const sf::Texture& texture() const;
+	const sf::Glyph& glyph(sf::Uint32 code, bool bold) const;
+	std::string m_string;
+	const sf::Font* m_font = nullptr;
+	unsigned int m_size = 30;
+	sf::Uint32 m_style = sf::Text::Regular;
+	sf::Color m_color = sf::Color::White;
+	mutable sf::VertexArray m_vertices;
+	mutable sf::FloatRect m_bounds;
+	mutable sf::Vector2u m_texture_size; // glyph page grew -> lay out again
+	mutable bool m_layout_dirty = true;
+	mutable bool m_color_dirty = false;
+};
+
 class CFlowText : public CGameObject
 {
 public:
@@ -319,10 +706,11 @@ public:
 	virtual void draw(sf::RenderWindow* window) override;
 	bool isFlashing() const;
 	void setSplashVector(const Vector& vector);
+	void loadGlyphs() const;
 	CFlowText* clone() const;
 private:
 	bool m_self_remove = false;
-	sf::Text m_text;
+	CRetainedText m_text;
 	Vector m_offset;
 	Vector m_splash_vector = {1,-1};
 	float m_time;
@@ -338,6 +726,7 @@ public:
 	CLabel(const std::string& str);
 	void setSprite(const sf::Sprite& sprite);
 	void setString(const std::string& str);
+	void setString(const char* str);
 	void setTextAlign(int value);
 	void setFontColor(const sf::Color& color);
 	void setFontSize(int size);
@@ -349,6 +738,7 @@ public:
 	void setFontName(const sf::Font& font);
 	void setFontStyle(sf::Uint32 style);
 	bool contains(const Vector& point) const;
+	void loadGlyphs() const;
 	CLabel* clone() const;
 	virtual void draw(sf::RenderWindow* window) override;
 protected:
@@ -359,7 +749,7 @@ private:
 	int m_text_align = center;
 	sf::Sprite m_sprite;
 	Rect m_rect;
-	sf::Text m_text;
+	CRetainedText m_text;
 };
 
 class WaypointSystem : public CGameObject
@@ -368,9 +758,23 @@ private:
 	std::vector<Vector> m_path;
 	float m_length = 0;
 	float m_speed = 0;
+	Rect m_wrap_area;
 public:
+	enum { MAX_SAVED_PATH = 4 }; // longest path an object can be given, so a State always holds it
+	struct State
+	{
+		Vector path[MAX_SAVED_PATH];
+		int size;
+		float length;
+		float speed;
+	};
+	WaypointSystem();
+	void saveState(State& state) const;
+	void restoreState(const State& state);
 	CGameObject* getObject();
 	void addPath(const std::vector<Vector>& path, float speed, bool align = false);
+	// leaving the area on a side it has size along, the object and its path go over to the other side
+	void setWrapArea(const Rect& area);
 	bool isMoving() const;
 	void stop();
 	void update(int delta_time) override;
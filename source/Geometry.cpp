@@ -3,11 +3,6 @@
 
 //-----------------------------------------------------------------------------
 
-Vector::Vector(float x, float y) : x(x), y(y) {}
-Vector::Vector()
-{
-	x = y = 0;
-}
 Vector Vector::operator + (const Vector& two) const
 {
 	return Vector(x + two.x, y + two.y);
@@ -12,9 +12,10 @@ class Vector
 {
 public:
 	float x, y;
-	Vector(float x, float y);
-	Vector(int x, int y) :x((float)x), y((float)y) {};
-	Vector();
+	// constexpr: the direction constants below must be ready before any other static initializer reads them
+	constexpr Vector(float x, float y) : x(x), y(y) {};
+	constexpr Vector(int x, int y) :x((float)x), y((float)y) {};
+	constexpr Vector() : x(0), y(0) {};
 	Vector operator-() const;
 	Vector operator+ (const Vector& two) const;
 	Vector operator- (const Vector& two) const;
@@ -13,7 +13,7 @@ void CPinkyState::update(const CGhostStateContex& contex)
 		Vector start_cell = contex.walls->toMapCoordinates(contex.ghost->getPosition());
 		Vector target_cell = contex.walls->toMapCoordinates(contex.ghost->target()->getPosition());
 
-		Vector pinky_target = contex.walls->getMap()->getCell(target_cell, contex.ghost->target()->getDirection(), 4);
+		Vector pinky_target = contex.walls->wrap(contex.walls->getMap()->getCell(target_cell, contex.ghost->target()->getDirection(), 4));
 
 		if (contex.walls->inBounds(pinky_target) && contex.walls->getMapCell(pinky_target) == EMapBrickTypes::empty)
 			target_cell = pinky_target;
@@ -69,7 +69,8 @@ void CClydeState::update(const CGhostStateContex& contex)
 		Vector left_bottom_cell = Vector(1, contex.walls->getMap()->height() - 2);
 		Vector m_target;
 
-		if ((ghost_cell - pacman_cell).length() > 8)
+		int distance = contex.walls->mazeDistance(ghost_cell, pacman_cell);
+		if (distance >= 0 ? distance > 8 : (ghost_cell - pacman_cell).length() > 8)
 			m_target = pacman_cell;
 		else
 			m_target = left_bottom_cell;
@@ -94,7 +95,7 @@ void CFrightenedState::update(const CGhostStateContex& contex)
 		Vector target_cell;
 		do
 		{
-			target_cell = Vector(std::rand() % contex.walls->getMap()->width(), std::rand() % contex.walls->getMap()->height());
+			target_cell = Vector(contex.random->nextInt(contex.walls->getMap()->width()), contex.random->nextInt(contex.walls->getMap()->height()));
 		} while (contex.walls->getMapCell(target_cell) != EMapBrickTypes::empty);
 
 		contex.ghost->moveToTarget(contex.walls->toPixelCoordinates(target_cell));
@@ -102,12 +103,13 @@ void CFrightenedState::update(const CGhostStateContex& contex)
 
 	if (m_flashed)
 	{
-		m_time[contex.ghost->getName()] += contex.delta_time;
-		int i = int(m_time[contex.ghost->getName()] / 25) % 20;
+		GhostData& data = ghostData(contex.ghost);
+		data.time += contex.delta_time;
+		int i = int(data.time / 25) % 20;
 		if (i > 10)
 			contex.ghost->setColor(m_frightened_color);
 		else
-			contex.ghost->setColor(m_old_color[contex.ghost->getName()]);
+			contex.ghost->setColor(data.old_color);
 	}
 }
 
@@ -116,18 +118,54 @@ void CFrightenedState::setFlashed(bool flashed)
 	m_flashed = flashed;
 }
 
+bool CFrightenedState::isFlashed() const
+{
+	return m_flashed;
+}
+
+CFrightenedState::GhostData& CFrightenedState::ghostData(const CGhost* ghost)
+{
+	for (int i = 0; i < m_ghosts_count; ++i)
+		if (m_ghosts_data[i].ghost == ghost)
+			return m_ghosts_data[i];
+
+	assert(m_ghosts_count < (int)m_ghosts_data.size());
+	m_ghosts_data[m_ghosts_count] = { ghost, sf::Color(), 0 };
+	return m_ghosts_data[m_ghosts_count++];
+}
+
+void CFrightenedState::saveGhost(const CGhost* ghost, sf::Color& old_color, float& time) const
+{
+	old_color = sf::Color();
+	time = 0;
+	for (int i = 0; i < m_ghosts_count; ++i)
+		if (m_ghosts_data[i].ghost == ghost)
+		{
+			old_color = m_ghosts_data[i].old_color;
+			time = m_ghosts_data[i].time;
+		}
+}
+
+void CFrightenedState::restoreGhost(const CGhost* ghost, sf::Color old_color, float time)
+{
+	GhostData& data = ghostData(ghost);
+	data.old_color = old_color;
+	data.time = time;
+}
+
 void CFrightenedState::activate(const CGhostStateContex& contex)
 {
-	m_old_color[contex.ghost->getName()] = contex.ghost->color();
+	GhostData& data = ghostData(contex.ghost);
+	data.old_color = contex.ghost->color();
 	contex.ghost->setColor(m_frightened_color);
 	contex.ghost->setSpeed(contex.ghost->SCARRED_SPEED);
-	m_time[contex.ghost->getName()] = 0;
+	data.time = 0;
 	setFlashed(false);
 }
 
 void CFrightenedState::deactivate(const CGhostStateContex& contex)
 {
-	contex.ghost->setColor(m_old_color[contex.ghost->getName()]);
+	contex.ghost->setColor(ghostData(contex.ghost).old_color);
 	contex.ghost->setSpeed(contex.ghost->NORMAL_SPEED);
 }
 
@@ -138,16 +176,6 @@ void CFrightenedState::draw(const CGhostStateContex& state_contex, sf::RenderWin
 	state_contex.ghost->drawMouth(window);
 }
 
-CFrightenedState* CFrightenedState::getInstance()
-{
-	if (m_instance == nullptr)
-		m_instance = new 	CFrightenedState();
-	return m_instance;
-}
-
-CFrightenedState* CFrightenedState::m_instance = nullptr;
-bool CFrightenedState::m_flashed = false;
-
 //--------------------------------------------------------------------------------------------------
 
 CScatterState::CScatterState(Corner corner) : CGhostState(Type::Scatter)
@@ -160,36 +188,29 @@ void CScatterState::update(const CGhostStateContex& contex)
 	Vector ghost_cell = contex.walls->toMapCoordinates(contex.ghost->getPosition());
 
 	if (!contex.ghost->isMoving())
-		contex.ghost->moveToTarget(contex.walls->toPixelCoordinates(m_corner_cell));
+		contex.ghost->moveToTarget(contex.walls->toPixelCoordinates(cornerCell(contex)));
 }
 
 void CScatterState::activate(const CGhostStateContex& contex)
 {
 	m_stage = 0;
+}
+
+Vector CScatterState::cornerCell(const CGhostStateContex& contex) const
+{
 	Vector map_size(contex.walls->getMap()->width(), contex.walls->getMap()->height());
 
 	switch (m_corner)
 	{
 	case(Corner::left_up):
-	{
-		m_corner_cell = Vector(1, 1);
-		break;
-	}
+		return Vector(1, 1);
 	case(Corner::right_up):
-	{
-		m_corner_cell = Vector((int)map_size.x - 2, 1);
-		break;
-	}
+		return Vector((int)map_size.x - 2, 1);
 	case(Corner::left_bottom):
-	{
-		m_corner_cell = Vector(1, (int)map_size.y - 2);
-		break;
-	}
+		return Vector(1, (int)map_size.y - 2);
 	case(Corner::right_bottom):
-	{
-		m_corner_cell = Vector((int)map_size.x - 2, (int)map_size.y - 2);
-		break;
-	}
+	default:
+		return Vector((int)map_size.x - 2, (int)map_size.y - 2);
 	}
 }
 
@@ -235,6 +256,16 @@ void CSoulState::draw(const CGhostStateContex& contex, sf::RenderWindow* window)
 	contex.ghost->drawEyes(window);
 }
 
+int CSoulState::stage() const
+{
+	return m_stage;
+}
+
+void CSoulState::setStage(int stage)
+{
+	m_stage = stage;
+}
+
 //--------------------------------------------------------------------------------------------------
 
 CBorningState::CBorningState(Vector ghost_house_door) : CGhostState(Type::Borning)
@@ -271,15 +302,13 @@ void CInHouseState::update(const CGhostStateContex& contex)
 
 	if (!contex.ghost->isMoving())
 	{
-		Vector next_cell = contex.walls->toMapCoordinates(contex.ghost->getPosition()) + Vector::left;
+		Vector next_cell = contex.walls->wrap(contex.walls->toMapCoordinates(contex.ghost->getPosition()) + Vector::left);
 		bool can_turn = !(!contex.walls->inBounds(next_cell) || contex.walls->getMapCell(next_cell) != EMapBrickTypes::empty);
 
 		Vector direction = can_turn ? Vector::left : Vector::right;
 
 		Vector player_cell = contex.walls->toMapCoordinates(contex.ghost->getPosition());
-		Vector finish_cell = contex.walls->getMap()->traceLine(player_cell, direction, EMapBrickTypes::empty);
-
-		contex.ghost->setMovingPath(contex.walls->toPixelCoordinates({ player_cell,finish_cell }));
+		contex.ghost->setMovingPath(contex.walls->straightPath(player_cell, direction));
 	};
 
 }
@@ -287,7 +316,7 @@ void CInHouseState::update(const CGhostStateContex& contex)
 void CInHouseState::activate(const CGhostStateContex& contex)
 {
 	contex.ghost->stop();
-	contex.ghost->setPosition(contex.walls->toPixelCoordinates(m_ghost_house_door + Vector(0, 2)) + Vector(10 * (rand() % 4), 0));
+	contex.ghost->setPosition(contex.walls->toPixelCoordinates(m_ghost_house_door + Vector(0, 2)) + Vector(10 * contex.random->nextInt(4), 0));
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -38,19 +38,27 @@ public:
 class CFrightenedState : public CGhostState
 {
 public:
-	static CFrightenedState* getInstance();
+	CFrightenedState();
 	virtual void update(const CGhostStateContex& contex) override;
 	virtual void activate(const CGhostStateContex& contex) override;
 	virtual void deactivate(const CGhostStateContex& contex) override;
 	virtual void draw(const CGhostStateContex& contex, sf::RenderWindow* window);
-	static void setFlashed(bool flashed);
+	void setFlashed(bool flashed);
+	bool isFlashed() const;
+	void saveGhost(const CGhost* ghost, sf::Color& old_color, float& time) const;
+	void restoreGhost(const CGhost* ghost, sf::Color old_color, float time);
 private:
-	CFrightenedState();
-	static CFrightenedState* m_instance;
-	std::map<std::string, sf::Color> m_old_color;
-	std::map<std::string, float> m_time;
+	struct GhostData
+	{
+		const CGhost* ghost;
+		sf::Color old_color;
+		float time;
+	};
+	GhostData& ghostData(const CGhost* ghost);
+	std::array<GhostData, 4> m_ghosts_data;
+	int m_ghosts_count = 0;
 	sf::Color m_frightened_color = sf::Color(0, 0, 200);
-	static bool m_flashed;
+	bool m_flashed;
 };
 
 class CScatterState : public CGhostState
@@ -62,8 +70,8 @@ public:
 	virtual void activate(const CGhostStateContex& contex) override;
 	virtual void deactivate(const CGhostStateContex& contex) override;
 private:
+	Vector cornerCell(const CGhostStateContex& contex) const;
 	Corner m_corner;
-	Vector m_corner_cell;
 	int m_stage = 0;
 };
 
@@ -74,9 +82,11 @@ public:
 	virtual void update(const CGhostStateContex& contex) override;
 	virtual void activate(const CGhostStateContex& contex) override;
 	virtual void draw(const CGhostStateContex&, sf::RenderWindow* window) override;
+	int stage() const;
+	void setStage(int stage);
 private:
 	Vector m_ghost_house_door;
-	int m_stage;
+	int m_stage = 0;
 };
 
 class CBorningState : public CGhostState
@@ -0,0 +1,133 @@
+#include "GlyphCache.h"
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_GLYPH_H
+#include FT_OUTLINE_H
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+CGlyphCache& CGlyphCache::instance()
+{
+	static CGlyphCache cache;
+	return cache;
+}
+
+CGlyphCache::~CGlyphCache()
+{
+	if (m_library)
+		FT_Done_FreeType(static_cast<FT_Library>(m_library));
+}
+
+void CGlyphCache::addFont(const sf::Font* font, const std::string& file_path)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_files[font] = file_path;
+}
+
+const sf::Glyph& CGlyphCache::glyph(const sf::Font* font, sf::Uint32 code, unsigned int size, bool bold)
+{
+	static const sf::Glyph none = sf::Glyph();
+	if (code < ' ' || code > '~')
+		return none;
+	return page(font, size, bold).glyphs[code - ' '];
+}
+
+const sf::Texture& CGlyphCache::texture(const sf::Font* font, unsigned int size, bool bold)
+{
+	return page(font, size, bold).texture->texture();
+}
+
+// pages are complete once made and never removed, so what they hand out stays valid unlocked
+const CGlyphCache::Page& CGlyphCache::page(const sf::Font* font, unsigned int size, bool bold)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Page& page = m_pages[std::make_tuple(font, size, bold)];
+	if (!page.texture)
+		render(page, m_files[font], size, bold);
+	return page;
+}
+
+// sf::Font::loadGlyph for one page at once: same hinting, emboldening and 2 pixel padding
+void CGlyphCache::render(Page& page, const std::string& file_path, unsigned int size, bool bold)
+{
+	struct Bitmap
+	{
+		unsigned int width, height;
+		std::vector<sf::Uint8> alpha;
+	};
+	std::vector<Bitmap> bitmaps('~' - ' ' + 1);
+
+	FT_Face face = nullptr;
+	if (!m_library && FT_Init_FreeType(reinterpret_cast<FT_Library*>(&m_library)) != 0)
+		m_library = nullptr;
+	if (!m_library || FT_New_Face(static_cast<FT_Library>(m_library), file_path.c_str(), 0, &face) != 0)
+		std::cout << "can't load glyphs from " << (file_path.empty() ? "an unregistered font" : file_path) << std::endl;
+	else if (FT_Set_Pixel_Sizes(face, 0, size) != 0)
+		std::cout << file_path << ": no size " << size << std::endl;
+	else
+		for (sf::Uint32 code = ' '; code <= '~'; ++code)
+		{
+			FT_Glyph glyph_desc;
+			if (FT_Load_Char(face, code, FT_LOAD_TARGET_NORMAL | FT_LOAD_FORCE_AUTOHINT) != 0 ||
+				FT_Get_Glyph(face->glyph, &glyph_desc) != 0)
+				continue;
+
+			const FT_Pos weight = 1 << 6;
+			bool outline = glyph_desc->format == FT_GLYPH_FORMAT_OUTLINE;
+			if (bold && outline)
+				FT_Outline_Embolden(&reinterpret_cast<FT_OutlineGlyph>(glyph_desc)->outline, weight);
+			FT_Glyph_To_Bitmap(&glyph_desc, FT_RENDER_MODE_NORMAL, 0, 1);
+			FT_BitmapGlyph bitmap_glyph = reinterpret_cast<FT_BitmapGlyph>(glyph_desc);
+			const FT_Bitmap& bitmap = bitmap_glyph->bitmap;
+
+			sf::Glyph& glyph = page.glyphs[code - ' '];
+			glyph.advance = (float)face->glyph->metrics.horiAdvance / (1 << 6) + (bold ? (float)weight / (1 << 6) : 0.f);
+			glyph.bounds = sf::FloatRect((float)bitmap_glyph->left, (float)-bitmap_glyph->top, (float)bitmap.width, (float)bitmap.rows);
+
+			Bitmap& copy = bitmaps[code - ' '];
+			copy.width = bitmap.width;
+			copy.height = bitmap.rows;
+			copy.alpha.resize(std::size_t(copy.width) * copy.height);
+			bool mono = bitmap.pixel_mode == FT_PIXEL_MODE_MONO;
+			for (unsigned int y = 0; y < copy.height; ++y)
+			{
+				const unsigned char* row = bitmap.buffer + y * bitmap.pitch;
+				for (unsigned int x = 0; x < copy.width; ++x)
+					copy.alpha[y * copy.width + x] = mono ? ((row[x / 8] >> (7 - x % 8)) & 1 ? 255 : 0) : row[x];
+			}
+			FT_Done_Glyph(glyph_desc);
+		}
+	if (face)
+		FT_Done_Face(face);
+
+	// shelves from left to right, a new one when the row is full
+	const unsigned int padding = 2, width = 512;
+	unsigned int x = 0, y = 0, shelf = 0;
+	for (std::size_t i = 0; i < bitmaps.size(); ++i)
+	{
+		if (!bitmaps[i].width || !bitmaps[i].height)
+			continue;
+		unsigned int w = bitmaps[i].width + 2 * padding, h = bitmaps[i].height + 2 * padding;
+		if (x + w > width)
+		{
+			x = 0;
+			y += shelf;
+			shelf = 0;
+		}
+		page.glyphs[i].textureRect = sf::IntRect(x + padding, y + padding, bitmaps[i].width, bitmaps[i].height);
+		x += w;
+		shelf = std::max(shelf, h);
+	}
+
+	sf::Image image;
+	image.create(width, std::max(y + shelf, 1u), sf::Color(255, 255, 255, 0));
+	for (std::size_t i = 0; i < bitmaps.size(); ++i)
+	{
+		const sf::IntRect& rect = page.glyphs[i].textureRect;
+		for (unsigned int gy = 0; gy < bitmaps[i].height; ++gy)
+			for (unsigned int gx = 0; gx < bitmaps[i].width; ++gx)
+				image.setPixel(rect.left + gx, rect.top + gy, sf::Color(255, 255, 255, bitmaps[i].alpha[gy * bitmaps[i].width + gx]));
+	}
+	page.texture.reset(new CTextureStandIn(image));
+}
@@ -0,0 +1,40 @@
+#ifndef GLYPHCACHE_H
+#define GLYPHCACHE_H
+
+#include "SoftwareRenderer.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+// sf::Font's glyph pages without a GPU: the glyphs ' '..'~' of a font, size and weight are
+// rasterized with FreeType the way sf::Font does and packed into one image, kept behind a
+// CTextureStandIn. Other characters have no glyph. Shared between threads.
+class CGlyphCache
+{
+public:
+	static CGlyphCache& instance();
+	~CGlyphCache();
+	// the .ttf font was loaded from, needed before its glyphs are asked for
+	void addFont(const sf::Font* font, const std::string& file_path);
+	const sf::Glyph& glyph(const sf::Font* font, sf::Uint32 code, unsigned int size, bool bold);
+	const sf::Texture& texture(const sf::Font* font, unsigned int size, bool bold);
+
+private:
+	struct Page
+	{
+		sf::Glyph glyphs['~' - ' ' + 1];
+		std::unique_ptr<CTextureStandIn> texture;
+	};
+	CGlyphCache() = default;
+	const Page& page(const sf::Font* font, unsigned int size, bool bold);
+	void render(Page& page, const std::string& file_path, unsigned int size, bool bold);
+
+	std::mutex m_mutex;
+	void* m_library = nullptr; // FT_Library, FreeType stays out of the header
+	std::map<const sf::Font*, std::string> m_files;
+	std::map<std::tuple<const sf::Font*, unsigned int, bool>, Page> m_pages;
+};
+
+#endif
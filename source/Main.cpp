@@ -1,7 +1,154 @@
 #include "PacManGame.h"
+#include "Profiler.h"
+#include "SoftwareRenderer.h"
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <thread>
+#include <algorithm>
 
 int main(int argc, char* argv[])
 {
+	// the modes without a window never touch the GPU, not even to load textures
+	for (int i = 1; i < argc; ++i)
+		for (const char* mode : { "--headless", "--simulate", "--replay", "--capture" })
+			if (std::strcmp(argv[i], mode) == 0)
+				CGame::setGpuless(true);
+
+	// PacMan --profile <file> [mode]: profile the game thread, <file> is written at exit (F11/F12 work without it)
+	bool profile = argc > 2 && std::strcmp(argv[1], "--profile") == 0;
+	if (profile)
+	{
+		CPacManGame::instance()->setProfileFile(argv[2]);
+		CProfiler::instance().setEnabled(true);
+		argc -= 2;
+		argv += 2;
+	}
+	auto finish = [profile]() { if (profile) CPacManGame::instance()->dumpProfile(); return 0; };
+
+	// PacMan [--profile ...] --autopilot [us] [mode]: Pac-Man plays himself, searching at most <us>
+	// microseconds per decision (1000 by default)
+	if (argc > 1 && std::strcmp(argv[1], "--autopilot") == 0)
+	{
+		bool has_budget = argc > 2 && std::isdigit((unsigned char)argv[2][0]);
+		int budget = has_budget ? std::atoi(argv[2]) : 1000;
+		CPacManGame::instance()->setAutopilot(true, sf::microseconds(budget));
+		argc -= has_budget ? 2 : 1;
+		argv += has_budget ? 2 : 1;
+	}
+
+	// PacMan --headless [ticks]: simulate one game without a window
+	if (argc > 1 && std::strcmp(argv[1], "--headless") == 0)
+	{
+		int ticks = argc > 2 ? std::atoi(argv[2]) : 0;
+		CPacManGame* game = CPacManGame::instance();
+		sf::Clock clock;
+		int done = game->runHeadless(ticks, [game]() { return !game->isPlaying(); });
+		std::cout << "ticks: " << done << ", time: " << clock.getElapsedTime().asMilliseconds() << " ms" << std::endl;
+		return finish();
+	}
+
+	// PacMan --simulate <games> [threads]: independent headless games on worker threads
+	if (argc > 1 && std::strcmp(argv[1], "--simulate") == 0)
+	{
+		int games = argc > 2 ? std::atoi(argv[2]) : 1;
+		int threads = argc > 3 ? std::atoi(argv[3]) : (int)std::thread::hardware_concurrency();
+		sf::Clock clock;
+		std::vector<int> scores = CPacManGame::instance()->simulate(games, std::max(threads, 1));
+		float seconds = clock.getElapsedTime().asSeconds();
+		long long total = 0;
+		for (int score : scores)
+			total += score;
+		std::cout << "games: " << games << ", games/s: " << games / seconds << ", average score: " << (games ? total / games : 0) << std::endl;
+		return finish();
+	}
+
+	// PacMan --replay <file> [session]: re-simulate a recorded game headless
+	if (argc > 2 && std::strcmp(argv[1], "--replay") == 0)
+	{
+		CPacManGame* game = CPacManGame::instance();
+		sf::Clock clock;
+		int ticks = game->replay(argv[2], argc > 3 ? std::atoi(argv[3]) : 0);
+		std::cout << "ticks: " << ticks << ", score: " << game->score() << ", time: " << clock.getElapsedTime().asMilliseconds() << " ms" << std::endl;
+		return finish();
+	}
+
+	// PacMan --capture <file> <dir> [every] [width height]: replay <file> and rasterize every <every>th
+	// tick on the CPU into <dir>/frame_NNNNNN.png, at the window size unless given; needs no display
+	if (argc > 3 && std::strcmp(argv[1], "--capture") == 0)
+	{
+		CPacManGame* game = CPacManGame::instance();
+		std::string dir = argv[3];
+		int every = argc > 4 ? std::max(1, std::atoi(argv[4])) : 1;
+		unsigned width = argc > 6 ? (unsigned)std::atoi(argv[5]) : (unsigned)game->screenSize().x;
+		unsigned height = argc > 6 ? (unsigned)std::atoi(argv[6]) : (unsigned)game->screenSize().y;
+
+		CSoftwareRenderer renderer;
+		renderer.create(width, height);
+		sf::Image frame;
+		CDisplayList list;
+		int frames = 0;
+		sf::Time raster;
+		char path[1024];
+
+		int ticks = game->replay(argv[2], 0, [&](int tick)
+		{
+			if (tick % every)
+				return;
+			sf::Clock clock;
+			game->record(list);
+			renderer.clear(game->clearColor());
+			renderer.draw(list);
+			raster += clock.getElapsedTime();
+
+			renderer.copyTo(frame);
+			std::snprintf(path, sizeof(path), "%s/frame_%06d.png", dir.c_str(), tick);
+			if (!frame.saveToFile(path))
+				std::cout << "can't write " << path << std::endl;
+			++frames;
+		});
+		std::cout << "ticks: " << ticks << ", frames: " << frames << ", record+raster: "
+			<< (frames ? raster.asMicroseconds() / frames : 0) << " us/frame" << std::endl;
+		return finish();
+	}
+
+	// PacMan --record <file>: play normally, every started game is appended to <file>
+	static CInputRecorder recorder; // static: closed by exit() when the window closes
+	if (argc > 2 && std::strcmp(argv[1], "--record") == 0)
+	{
+		if (!recorder.open(argv[2]))
+			std::cout << "can't open " << argv[2] << std::endl;
+		CPacManGame::instance()->inputManager().setRecorder(&recorder);
+	}
+
+	// PacMan [--single-thread] [--tick-rate <hz>] [--fps <hz>] [--vsync] [--catch-up <policy> [max ticks]]:
+	// draw on the simulation thread instead of a render thread; simulate at <hz> instead of 60
+	// (the display interpolates in between); draw at <hz> instead of 120 (0: unlimited) or in
+	// step with the display; what to do when updates fall behind (see CCatchUp)
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--single-thread") == 0)
+			CPacManGame::instance()->setRenderThread(false);
+		else if (std::strcmp(argv[i], "--tick-rate") == 0 && i + 1 < argc)
+			CPacManGame::instance()->setUpdateStep(sf::seconds(1.f / std::max(1, std::atoi(argv[++i]))));
+		else if (std::strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+			CPacManGame::instance()->setFrameRate((float)std::max(0, std::atoi(argv[++i])));
+		else if (std::strcmp(argv[i], "--vsync") == 0)
+			CPacManGame::instance()->setVerticalSync(true);
+		else if (std::strcmp(argv[i], "--catch-up") == 0 && i + 1 < argc)
+		{
+			CCatchUp::Policy policy;
+			if (!CCatchUp::parse(argv[++i], policy))
+			{
+				std::cout << "unknown catch-up policy " << argv[i] << ", use unbounded, limit, dilate or drop" << std::endl;
+				return 1;
+			}
+			int max_ticks = i + 1 < argc && std::atoi(argv[i + 1]) > 0 ? std::atoi(argv[++i]) : 5;
+			CPacManGame::instance()->setCatchUp(policy, max_ticks);
+		}
+	}
+
 	CPacManGame::instance()->run();
 	return 0;
 }
@@ -3,13 +3,26 @@
 #include <iostream>
 #include <algorithm>
 #include "GhostStates.h"
+#include "SpriteBatch.h"
+#include "SoftwareRenderer.h"
+#include "Autopilot.h"
 #include <math.h>
+#include <thread>
+#include <atomic>
+#include <cstring>
+
+// atoms of the names looked up while playing
+static const int s_inky_name = CGameObject::internName("Inky");
+static const int s_clyde_name = CGameObject::internName("Clyde");
+static const int s_pill_name = CGameObject::internName("Pill");
+static const int s_game_scene_name = CGameObject::internName("game_scene");
+static const int s_menu_scene_name = CGameObject::internName("menu_scene");
 
 //--------------------------------------------------------------------------------------------
 void CPacManGameScene::addScore(int score)
 {
 	m_score += score;
-	m_score_label->setString("Score: " + toString(m_score));
+	m_hud_dirty = true;
 }
 
 void CPacManGameScene::resetScore()
@@ -23,7 +36,7 @@ void CPacManGameScene::enableActors(bool value)
 	auto ghosts = findObjectsByType<CGhost>();
 	auto pacman = findObjectByType<CPacman>();
 
-	for (auto& ghost : ghosts)
+	for (auto ghost : ghosts)
 		if (value)
 			ghost->enable();
 		else
@@ -35,19 +48,21 @@ void CPacManGameScene::enableActors(bool value)
 		  pacman->disable();
 }
 
-CPacManGameScene::CPacManGameScene()
+CPacManGameScene::CPacManGameScene(CGameContext* context)
 {
-	CPacManGame::instance()->eventManager().subscribe(this);
+	registerType<CPacManGameScene>();
+	m_context = context;
+	m_context->eventManager().subscribe(this);
 
 	addObject(m_wave_timer = new CTimer());
 	addObject(m_pill_timer = new CTimer());
 	addObject(m_born_timer = new CTimer());
 	addObject(m_fruit_timer = new CTimer());
 
-	addObject(m_walls = new CWalls(28, 31));
+	addObject(m_walls = new CWalls(m_context, 28, 31));
 	addObject(m_dots = new CDots(m_walls));
-	addObject(m_pacman = new CPacman(m_walls));
-	addObject(m_fruit = new CFruit());
+	addObject(m_pacman = new CPacman(m_context, m_walls));
+	addObject(m_fruit = new CFruit(m_context));
 
 	initGhostsStates();
 	createGui();
@@ -58,20 +73,7 @@ CPacManGameScene::CPacManGameScene()
 
 void CPacManGameScene::loadStage(const std::string& name)
 {
-	m_walls->getMap()->loadFromFile(
-	{
-		{ '*', EMapBrickTypes::full },
-		{ '.', EMapBrickTypes::dot },
-		{ 'P', EMapBrickTypes::pacman_spawn },
-		{ ' ', EMapBrickTypes::empty },
-		{ 'p', EMapBrickTypes::pill },
-		{ 'G', EMapBrickTypes::ghost_spawn },
-		{ 'F', EMapBrickTypes::fruit },
-		{ '1', EMapBrickTypes::door_lu },
-		{ '2', EMapBrickTypes::door_ru },
-		{ '3', EMapBrickTypes::door_ld },
-		{ '4', EMapBrickTypes::door_rd }
-	}, "res/levels/"+ name +".txt");
+	m_walls->load("res/levels/"+ name +".txt");
 
 	m_dots->fill(m_walls);
 	
@@ -81,13 +83,13 @@ void CPacManGameScene::loadStage(const std::string& name)
 	m_fruit->hide();
 
 	auto pills = findObjectsByType<CPill>();
-	for (auto& pill : pills)
+	for (auto pill : pills)
 		removeObject(pill);
 
 	auto pills_cells = m_walls->getMap()->getCells(EMapBrickTypes::pill);
 	for (auto& pill_cell : pills_cells)
 	{
-		auto pill = new CPill();
+		auto pill = new CPill(m_context);
 		pill->setPosition(m_walls->toPixelCoordinates(pill_cell));
 		addObject(pill);
 		m_pills.push_back(pill);
@@ -95,6 +97,11 @@ void CPacManGameScene::loadStage(const std::string& name)
 
 	m_pacman_spawn_position = m_walls->getMap()->getCells(EMapBrickTypes::pacman_spawn)[0] + Vector(0.5, 0);
 	m_walls->lining();
+
+	// the ghosts chasing Pac-Man himself share one field from his cell
+	m_pacman_field.setMap(*m_walls->getMap(), EMapBrickTypes::empty);
+	for (CGhost* ghost : m_ghosts)
+		ghost->setTargetField(&m_pacman_field);
 }
 
 void CPacManGameScene::initGhostsStates()
@@ -118,16 +125,18 @@ void CPacManGameScene::initGhostsStates()
 	};
 
 	Vector ghost_house_door_cell(13.5, 12);
+	m_frightened_state = new CFrightenedState();
 
 	for (int i = 0; i < 4; ++i)
 	{
-		CGhost* ghost = new CGhost(ghost_names[i], m_pacman, m_walls);
+		CGhost* ghost = new CGhost(m_context, ghost_names[i], m_pacman, m_walls);
 		ghost->setColor(ghost_colors[i]);
+		ghost->setRandom(&m_random);
 		m_ghosts[i] = ghost;
 		addObject(ghost);
 
 		m_ghost_states[GhostStates::scatter][ghost_names[i]] = new CScatterState(ghost_corners[i]);
-		m_ghost_states[GhostStates::frightened][ghost_names[i]] = CFrightenedState::getInstance();
+		m_ghost_states[GhostStates::frightened][ghost_names[i]] = m_frightened_state;
 		m_ghost_states[GhostStates::souls][ghost_names[i]] = new CSoulState(ghost_house_door_cell);
 		m_ghost_states[GhostStates::borning][ghost_names[i]] = new CBorningState(ghost_house_door_cell);
 		m_ghost_states[GhostStates::in_ghost_house][ghost_names[i]] = new CInHouseState(Vector(13.5, 12));
@@ -143,20 +152,20 @@ void CPacManGameScene::initGhostsStates()
 
 void CPacManGameScene::createGui()
 {
-	m_big_text = new CButton();
-	m_big_text->setFontName(*CPacManGame::instance()->fontManager().get("main_font"));
+	m_big_text = new CButton(m_context);
+	m_big_text->setFontName(*m_context->fontManager().get("main_font"));
 	m_big_text->setFontStyle(sf::Text::Bold);
 	m_big_text->setFontSize(30);
 	m_big_text->setFontColor(sf::Color(50, 50, 50));
 	m_big_text->setPosition(m_walls->size().x / 2 + 15, m_walls->size().y / 2 + 42);
 	addObject(m_big_text);
 
-	m_flow_text = new CFlowText(*CPacManGame::instance()->fontManager().get("arial"));
+	m_flow_text = new CFlowText(*m_context->fontManager().get("arial"));
 	addObject(m_flow_text);
 
 	m_score_label = new CLabel();
 	m_score_label->setBounds(770, 40, 140, 30);
-	m_score_label->setFontName(*CPacManGame::instance()->fontManager().get("score_font"));
+	m_score_label->setFontName(*m_context->fontManager().get("score_font"));
 	m_score_label->setFontSize(32);
 	m_score_label->setTextAlign(CLabel::left);
 	m_score_label->setFontColor(sf::Color(0, 119, 170));
@@ -166,18 +175,18 @@ void CPacManGameScene::createGui()
 
 	CLabel* lives_label = new CLabel("Lives:");
 	lives_label->setBounds(770, 100, 140, 30);
-	lives_label->setFontName(*CPacManGame::instance()->fontManager().get("score_font"));
+	lives_label->setFontName(*m_context->fontManager().get("score_font"));
 	lives_label->setFontSize(32);
 	lives_label->setTextAlign(CLabel::left);
 	lives_label->setFontColor(sf::Color(0, 119, 170));
 	addObject(lives_label);
 
-	m_life_bar = new CLifeBar({ 800,150 });
+	m_life_bar = new CLifeBar(m_context, { 800,150 });
 	addObject(m_life_bar);
 
 	m_dots_label = new CLabel();
 	m_dots_label->setBounds(770, 250, 140, 30);
-	m_dots_label->setFontName(*CPacManGame::instance()->fontManager().get("score_font"));
+	m_dots_label->setFontName(*m_context->fontManager().get("score_font"));
 	m_dots_label->setFontSize(28);
 	m_dots_label->setTextAlign(CLabel::left);
 	m_dots_label->setFontColor(sf::Color(0, 119, 170));
@@ -185,8 +194,10 @@ void CPacManGameScene::createGui()
 	addObject(m_dots_label);
 }
 
-void CPacManGameScene::reset()
+void CPacManGameScene::reset(sf::Uint64 seed)
 {
+	m_random.setSeed(seed);
+	m_context->inputManager().beginSession(seed);
 	resetScore();
 	m_lives = 3;
 	
@@ -201,9 +212,9 @@ void CPacManGameScene::reset()
 		pill->enable();
 	}
 
-	m_score_label->setString("Score: 0");
 	m_lives = 3;
 	m_life_bar->setValue(3);
+	m_hud_dirty = true;
 
 	spawnGhosts();
 	spawnPacman();
@@ -211,18 +222,27 @@ void CPacManGameScene::reset()
 
 CPacManGameScene::~CPacManGameScene()
 {
-	CPacManGame::instance()->eventManager().unsubcribe(this);
+	m_context->eventManager().unsubcribe(this);
+}
+
+int CPacManGameScene::score() const
+{
+	return m_score;
 }
 
 void CPacManGameScene::goToMainMenu()
 {
-	CPacManGameScene* game_scene = CPacManGame::instance()->getRootObject()->findObjectByName<CPacManGameScene>("game_scene");
-	CMainMenuScene* menu_scene =   CPacManGame::instance()->getRootObject()->findObjectByName<CMainMenuScene>("menu_scene");
+	CGameObject* root = m_context->getRootObject();
+	CMainMenuScene* menu_scene = root ? root->findObjectByName<CMainMenuScene>(s_menu_scene_name) : nullptr;
 	
 	enableActors(true);
-	game_scene->turnOff();
-	menu_scene->reset();
-	menu_scene->turnOn();
+	turnOff();
+
+	if (menu_scene) // simulations run the game scene alone
+	{
+		menu_scene->reset();
+		menu_scene->turnOn();
+	}
 }
 
 void CPacManGameScene::update(int delta_time)
@@ -237,16 +257,15 @@ void CPacManGameScene::update(int delta_time)
 	 Vector player_claster = m_walls->toMapCoordinates(m_pacman->getPosition());
 	 if (m_dots->eat(player_claster.x, player_claster.y))
 	 {
-		 CPacManGame::instance()->playSound("eat_dot");
+		 m_context->playSound("eat_dot");
 		 addScore(1);
-		 m_dots_label->setString("Dots:" + toString(m_dots->amount()) + "/" + toString(m_dots->maxDots()));
 		 
 		 if (m_dots->amount() == 0)
 		 {
 			 enableActors(false);
-			 m_big_text->setString("You are win!");
+			 setBigText(BigText::win);
 			 m_wave_timer->clear();
-			 m_wave_timer->add(sf::seconds(3), std::bind(&CPacManGameScene::goToMainMenu, this));
+			 schedule(m_wave_timer, sf::seconds(3), TimerEvent::go_to_main_menu);
 			 return;
 		 }
 		 if (m_dots->amount() == m_dots->maxDots() - 70 || m_dots->amount() == m_dots->maxDots() - 170)
@@ -255,14 +274,14 @@ void CPacManGameScene::update(int delta_time)
 			 m_fruit->show();
 			 m_fruit_timer->clear();
 			 m_fruit->setFlashed(true);
-			 m_fruit_timer->add(sf::seconds(3),  [this]() {m_fruit->setFlashed(false); });
-			 m_fruit_timer->add(sf::seconds(20), [this]() {m_fruit->disable(); m_fruit->hide(); });
-			 m_fruit_timer->add(sf::seconds(17), [this]() {m_fruit->setFlashed(true); });
+			 schedule(m_fruit_timer, sf::seconds(3),  TimerEvent::fruit_steady);
+			 schedule(m_fruit_timer, sf::seconds(20), TimerEvent::fruit_gone);
+			 schedule(m_fruit_timer, sf::seconds(17), TimerEvent::fruit_flash);
 		 }
 		 if (m_dots->amount() == m_dots->maxDots() - 30)
 		 {
 			m_inky_unlock = true;
-			CGhost* inky = findObjectByName<CGhost>("Inky");
+			CGhost* inky = findObjectByName<CGhost>(s_inky_name);
 			if (inky->currentStateType() == CGhostState::Type::InHouse)
 			  setGhostState(inky, GhostStates::borning);
 		 }
@@ -270,7 +289,7 @@ void CPacManGameScene::update(int delta_time)
 		 if (m_dots->amount() == m_dots->maxDots() - 100)
 		 {
 			 m_clyde_unlock = true;
-			 CGhost* clyde = findObjectByName<CGhost>("Clyde");
+			 CGhost* clyde = findObjectByName<CGhost>(s_clyde_name);
 			 if (clyde->currentStateType() == CGhostState::Type::InHouse)
 				 setGhostState(clyde, GhostStates::borning);
 		 }
@@ -280,7 +299,7 @@ void CPacManGameScene::update(int delta_time)
 	 // FRUIT EAT PROCESSING 
 	 if (m_walls->toMapCoordinates(m_fruit->getPosition()) == player_claster && m_fruit->isEnabled())
 	 {
-		 CPacManGame::instance()->playSound("ghost_eaten");
+		 m_context->playSound("ghost_eaten");
 		 m_fruit->disable();
 		 m_fruit->hide();
 		 m_fruit_timer->clear();
@@ -298,19 +317,19 @@ void CPacManGameScene::update(int delta_time)
 			 if (m_lives > 0)
 			 {
 				 m_life_bar->setValue(m_lives);
-				 CPacManGame::instance()->playSound("life_lost");
+				 m_context->playSound("life_lost");
 				 enableActors(false);
 				 m_wave_timer->clear();
-				 m_wave_timer->add(sf::seconds(3), [this]() {  spawnGhosts();  spawnPacman(); });
+				 schedule(m_wave_timer, sf::seconds(3), TimerEvent::respawn);
 				 return;
 			 }
 			 else
 			 {
 				 enableActors(false);
-				 CPacManGame::instance()->playSound("life_lost");
-				 m_big_text->setString("Game over");
+				 m_context->playSound("life_lost");
+				 setBigText(BigText::game_over);
 				 m_wave_timer->clear();
-				 m_wave_timer->add(sf::seconds(3), std::bind(&CPacManGameScene::goToMainMenu, this));
+				 schedule(m_wave_timer, sf::seconds(3), TimerEvent::go_to_main_menu);
 			 }
 			 break;
 		 }
@@ -322,7 +341,7 @@ void CPacManGameScene::update(int delta_time)
 		 Vector monster_claster = m_walls->toMapCoordinates(obj->getPosition());
 		 if (monster_claster == player_claster && obj->currentStateType() == CGhostState::Frightened)
 		 {
-			 CPacManGame::instance()->playSound("ghost_eaten");
+			 m_context->playSound("ghost_eaten");
 			 m_flow_text->splash(m_pacman->getPosition(), "+200");
 			 addScore(200);
 			 setGhostState(obj,GhostStates::souls);
@@ -330,12 +349,13 @@ void CPacManGameScene::update(int delta_time)
 	 }
 
 	 //  MONSTER BORN PROCESING       
-	 for (auto& obj : m_ghosts)
+	 for (int i = 0; i < (int)m_ghosts.size(); ++i)
 	 {
+		 CGhost* obj = m_ghosts[i];
 		 if (obj->currentStateType() == CGhostState::Soul && !obj->isMoving())
 		 {
 			 obj->setState(m_ghost_states[GhostStates::in_ghost_house][obj->getName()]);
-			 m_born_timer->add(sf::seconds(5), [this, obj]() {   setGhostState(obj, GhostStates::borning);	 CPacManGame::instance()->playSound("ghost_regenerate"); });
+			 schedule(m_born_timer, sf::seconds(5), TimerEvent::ghost_reborn, i);
 		 }
 
 		 if (obj->currentStateType() == CGhostState::Borning && !obj->isMoving())
@@ -345,18 +365,14 @@ void CPacManGameScene::update(int delta_time)
 	 //PACMAN EAT PILL PROCESSING
 	 CGameObject* pill = NULL;
 	 foreachObject([&pill, this](CGameObject* object) {
-		 if (object->isEnabled() && object->getName() == "Pill" && m_walls->toMapCoordinates(m_pacman->getPosition()) == m_walls->toMapCoordinates(object->getPosition()))
+		 if (object->isEnabled() && object->getNameAtom() == s_pill_name && m_walls->toMapCoordinates(m_pacman->getPosition()) == m_walls->toMapCoordinates(object->getPosition()))
 		 {
 			 pill = object;
 			 m_wave_timer->disable();
 			 setGhostsToFrightenedState();
 			 m_pill_timer->clear();
-			 m_pill_timer->add(sf::seconds(7),  [this]() { CFrightenedState::setFlashed(true); });
-			 m_pill_timer->add(sf::seconds(10), [this]() { m_wave_timer->enable();
-			 if (getGhostsGlobalState() == GhostStates::scatter)
-				 setGhostsToScatterState();
-			 else if (getGhostsGlobalState() == GhostStates::chase)
-				 setGhostsToChaseState(); });
+			 schedule(m_pill_timer, sf::seconds(7),  TimerEvent::frightened_flash);
+			 schedule(m_pill_timer, sf::seconds(10), TimerEvent::frightened_end);
 		 }
 	 });
 
@@ -406,28 +422,248 @@ void CPacManGameScene::update(int delta_time)
 	 m_born_timer->clear();
 
 	 enableActors(false);
-	 m_big_text->setString("Get Ready!");
-	 CPacManGame::instance()->playSound("begininng");
+	 setBigText(BigText::get_ready);
+	 m_context->playSound("begininng");
 	 
 	 int t = 0;
 	 m_wave_timer->clear();
-	 m_wave_timer->add(sf::seconds(t += 2), [this]()  { m_big_text->setString(""); enableActors(true); });
-	 m_wave_timer->add(sf::seconds(t += 4), [this]() 
-	     {
-		    setGhostState(findObjectByName<CGhost>("Binky"), GhostStates::borning);
-			setGhostState(findObjectByName<CGhost>("Pinky"), GhostStates::borning);
-			if (m_inky_unlock)
-			 setGhostState(findObjectByName<CGhost>("Inky"),  GhostStates::borning);
-			if (m_clyde_unlock)
-			 setGhostState(findObjectByName<CGhost>("Clyde"), GhostStates::borning);
-	     });
-	 m_wave_timer->add(sf::seconds(t += 7), [this]()  { setGhostsToChaseState(); });
-	 m_wave_timer->add(sf::seconds(t += 20),[this]()  { setGhostsToScatterState(); });
-	 m_wave_timer->add(sf::seconds(t += 7), [this]()  { setGhostsToChaseState(); });
-	 m_wave_timer->add(sf::seconds(t += 20),[this]()  { setGhostsToScatterState(); });
-	 m_wave_timer->add(sf::seconds(t += 5), [this]()  { setGhostsToChaseState(); });
-	 m_wave_timer->add(sf::seconds(t += 20),[this]()  { setGhostsToScatterState(); });
-	 m_wave_timer->add(sf::seconds(t += 5), [this]()  { setGhostsToChaseState(); });
+	 schedule(m_wave_timer, sf::seconds(t += 2),  TimerEvent::start_round);
+	 schedule(m_wave_timer, sf::seconds(t += 4),  TimerEvent::release_ghosts);
+	 schedule(m_wave_timer, sf::seconds(t += 7),  TimerEvent::chase_wave);
+	 schedule(m_wave_timer, sf::seconds(t += 20), TimerEvent::scatter_wave);
+	 schedule(m_wave_timer, sf::seconds(t += 7),  TimerEvent::chase_wave);
+	 schedule(m_wave_timer, sf::seconds(t += 20), TimerEvent::scatter_wave);
+	 schedule(m_wave_timer, sf::seconds(t += 5),  TimerEvent::chase_wave);
+	 schedule(m_wave_timer, sf::seconds(t += 20), TimerEvent::scatter_wave);
+	 schedule(m_wave_timer, sf::seconds(t += 5),  TimerEvent::chase_wave);
+ }
+
+ // timer call backs are plain event ids, so pending ones survive a snapshot
+ void CPacManGameScene::schedule(CTimer* timer, sf::Time time, TimerEvent event, int arg)
+ {
+	 timer->add(time, [this, event, arg]() { onTimer(event, arg); }, event, arg);
+ }
+
+ void CPacManGameScene::onTimer(TimerEvent event, int arg)
+ {
+	 switch (event)
+	 {
+	 case TimerEvent::start_round:
+		 setBigText(BigText::no_text);
+		 enableActors(true);
+		 break;
+	 case TimerEvent::release_ghosts:
+		 setGhostState(m_ghosts[Binky], GhostStates::borning);
+		 setGhostState(m_ghosts[Pinky], GhostStates::borning);
+		 if (m_inky_unlock)
+			 setGhostState(m_ghosts[Inky], GhostStates::borning);
+		 if (m_clyde_unlock)
+			 setGhostState(m_ghosts[Clyde], GhostStates::borning);
+		 break;
+	 case TimerEvent::chase_wave:
+		 setGhostsToChaseState();
+		 break;
+	 case TimerEvent::scatter_wave:
+		 setGhostsToScatterState();
+		 break;
+	 case TimerEvent::respawn:
+		 spawnGhosts();
+		 spawnPacman();
+		 break;
+	 case TimerEvent::go_to_main_menu:
+		 goToMainMenu();
+		 break;
+	 case TimerEvent::fruit_steady:
+		 m_fruit->setFlashed(false);
+		 break;
+	 case TimerEvent::fruit_flash:
+		 m_fruit->setFlashed(true);
+		 break;
+	 case TimerEvent::fruit_gone:
+		 m_fruit->disable();
+		 m_fruit->hide();
+		 break;
+	 case TimerEvent::frightened_flash:
+		 m_frightened_state->setFlashed(true);
+		 break;
+	 case TimerEvent::frightened_end:
+		 m_wave_timer->enable();
+		 if (getGhostsGlobalState() == GhostStates::scatter)
+			 setGhostsToScatterState();
+		 else if (getGhostsGlobalState() == GhostStates::chase)
+			 setGhostsToChaseState();
+		 break;
+	 case TimerEvent::ghost_reborn:
+		 setGhostState(m_ghosts[arg], GhostStates::borning);
+		 m_context->playSound("ghost_regenerate");
+		 break;
+	 }
+ }
+
+ void CPacManGameScene::setBigText(BigText text)
+ {
+	 m_big_text_id = text;
+	 m_hud_dirty = true;
+ }
+
+ // labels are formatted only when someone draws them, headless games never pay for it
+ void CPacManGameScene::refreshHud()
+ {
+	 static const char* const big_texts[] = { "", "Get Ready!", "You are win!", "Game over" };
+	 m_big_text->setString(big_texts[m_big_text_id]);
+	 char text[32] = "Score: ";
+	 *appendInt(text + 7, m_score) = '\0';
+	 m_score_label->setString(text);
+
+	 std::strcpy(text, "Dots:");
+	 char* end = appendInt(text + 5, m_dots->amount());
+	 *end++ = '/';
+	 *appendInt(end, m_dots->maxDots()) = '\0';
+	 m_dots_label->setString(text);
+	 m_hud_dirty = false;
+ }
+
+ void CPacManGameScene::draw(sf::RenderWindow* window)
+ {
+	 if (m_hud_dirty)
+		 refreshHud();
+	 CGameObject::draw(window);
+ }
+
+ CPacManGameScene::GhostStates CPacManGameScene::ghostStateOf(CGhost* ghost)
+ {
+	 switch (ghost->currentStateType())
+	 {
+	 case CGhostState::Scatter:    return GhostStates::scatter;
+	 case CGhostState::Frightened: return GhostStates::frightened;
+	 case CGhostState::Soul:       return GhostStates::souls;
+	 case CGhostState::Borning:    return GhostStates::borning;
+	 case CGhostState::InHouse:    return GhostStates::in_ghost_house;
+	 default:                      return GhostStates::chase;
+	 }
+ }
+
+ bool CPacManGameScene::saveTimer(const CTimer* timer, CGameSnapshot::Timer& saved) const
+ {
+	 saved.size = 0;
+	 saved.enabled = timer->isEnabled();
+	 for (const auto& entry : timer->entries())
+		 if (entry.call_back) // cleared ones are only waiting to be erased
+		 {
+			 if (saved.size == CGameSnapshot::MAX_TIMER_EVENTS || entry.event < 0)
+				 return false;
+			 saved.events[saved.size++] = { entry.time, (sf::Int16)entry.event, (sf::Int16)entry.arg };
+		 }
+	 return true;
+ }
+
+ void CPacManGameScene::restoreTimer(CTimer* timer, const CGameSnapshot::Timer& saved)
+ {
+	 timer->clear();
+	 saved.enabled ? timer->enable() : timer->disable();
+	 for (int i = 0; i < saved.size; ++i)
+		 schedule(timer, saved.events[i].time, (TimerEvent)saved.events[i].event, saved.events[i].arg);
+ }
+
+ bool CPacManGameScene::saveSnapshot(CGameSnapshot& snapshot) const
+ {
+	 m_random.getState(snapshot.random);
+	 snapshot.score = m_score;
+	 snapshot.lives = m_lives;
+	 snapshot.ghosts_global_state = m_ghosts_global_state;
+	 snapshot.big_text = m_big_text_id;
+	 snapshot.enabled = isEnabled();
+	 snapshot.inky_unlock = m_inky_unlock;
+	 snapshot.clyde_unlock = m_clyde_unlock;
+	 snapshot.frightened_flashed = m_frightened_state->isFlashed();
+
+	 m_pacman->saveState(snapshot.pacman);
+
+	 for (int i = 0; i < (int)m_ghosts.size(); ++i)
+	 {
+		 CGhost* ghost = m_ghosts[i];
+		 CGameSnapshot::Ghost& saved = snapshot.ghosts[i];
+		 ghost->saveState(saved);
+		 saved.state = ghostStateOf(ghost);
+		 saved.soul_stage = saved.state == GhostStates::souls ? static_cast<CSoulState*>(ghost->currentState())->stage() : 0;
+		 m_frightened_state->saveGhost(ghost, saved.frightened_old_color, saved.frightened_time);
+	 }
+
+	 snapshot.fruit_enabled = m_fruit->isEnabled();
+	 snapshot.fruit_visible = m_fruit->isVisible();
+	 snapshot.fruit_flashed = m_fruit->isFlashed();
+	 snapshot.fruit_time = m_fruit->flashTime();
+
+	 int pills = std::min((int)m_pills.size(), (int)CGameSnapshot::MAX_PILLS);
+	 snapshot.pills = 0;
+	 for (int i = 0; i < pills; ++i)
+		 if (m_pills[i]->isEnabled())
+			 snapshot.pills |= 1u << i;
+
+	 snapshot.dots_amount = m_dots->amount();
+	 m_dots->saveState(snapshot.dots);
+
+	 bool complete = pills == (int)m_pills.size();
+	 complete = saveTimer(m_wave_timer, snapshot.timers[0]) && complete;
+	 complete = saveTimer(m_pill_timer, snapshot.timers[1]) && complete;
+	 complete = saveTimer(m_born_timer, snapshot.timers[2]) && complete;
+	 complete = saveTimer(m_fruit_timer, snapshot.timers[3]) && complete;
+	 return complete;
+ }
+
+ // puts every piece back as it was, states are swapped in without activate() so nothing is re-rolled
+ void CPacManGameScene::restoreSnapshot(const CGameSnapshot& snapshot)
+ {
+	 m_random.setState(snapshot.random);
+	 m_score = snapshot.score;
+	 m_lives = snapshot.lives;
+	 m_ghosts_global_state = (GhostStates)snapshot.ghosts_global_state;
+	 m_big_text_id = (BigText)snapshot.big_text;
+	 snapshot.enabled ? turnOn() : turnOff();
+	 m_inky_unlock = snapshot.inky_unlock;
+	 m_clyde_unlock = snapshot.clyde_unlock;
+	 m_frightened_state->setFlashed(snapshot.frightened_flashed);
+
+	 m_pacman->restoreState(snapshot.pacman);
+
+	 for (int i = 0; i < (int)m_ghosts.size(); ++i)
+	 {
+		 CGhost* ghost = m_ghosts[i];
+		 const CGameSnapshot::Ghost& saved = snapshot.ghosts[i];
+		 CGhostState* state = m_ghost_states[saved.state][ghost->getName()];
+		 ghost->restoreState(saved, state);
+		 if (saved.state == GhostStates::souls)
+			 static_cast<CSoulState*>(state)->setStage(saved.soul_stage);
+		 m_frightened_state->restoreGhost(ghost, saved.frightened_old_color, saved.frightened_time);
+	 }
+
+	 snapshot.fruit_enabled ? m_fruit->enable() : m_fruit->disable();
+	 snapshot.fruit_visible ? m_fruit->show() : m_fruit->hide();
+	 m_fruit->restoreFlash(snapshot.fruit_flashed, snapshot.fruit_time);
+
+	 for (int i = 0; i < std::min((int)m_pills.size(), (int)CGameSnapshot::MAX_PILLS); ++i)
+		 if (snapshot.pills & (1u << i))
+			 m_pills[i]->turnOn();
+		 else
+			 m_pills[i]->turnOff();
+
+	 m_dots->restoreState(snapshot.dots, snapshot.dots_amount);
+
+	 restoreTimer(m_wave_timer, snapshot.timers[0]);
+	 restoreTimer(m_pill_timer, snapshot.timers[1]);
+	 restoreTimer(m_born_timer, snapshot.timers[2]);
+	 restoreTimer(m_fruit_timer, snapshot.timers[3]);
+
+	 m_life_bar->setValue(m_lives);
+	 m_hud_dirty = true;
+ }
+
+ void CPacManGameScene::setAutopilot(bool enabled, sf::Time budget)
+ {
+	 if (enabled)
+		 m_pacman->setController(std::unique_ptr<CPacmanController>(new CAutopilot(this, budget)));
+	 else
+		 m_pacman->setController(std::unique_ptr<CPacmanController>(new CKeyboardController(m_context)));
  }
 
  void CPacManGameScene::spawnPacman()
@@ -446,10 +682,11 @@ void CPacManGameScene::update(int delta_time)
  }
  void CPacManGameScene::setGhostsToFrightenedState()
  {
-	 CPacManGame::instance()->playSound("ghosts_frightened");
+	 m_context->playSound("ghosts_frightened");
 
 	 m_ghosts_global_state = GhostStates::frightened;
-	 std::cout << "frighten mode" << std::endl;
+	 if (!m_context->isMuted()) // headless and simulated games run quietly
+		 std::cout << "frighten mode" << std::endl;
 	 for (auto& obj : m_ghosts)
 		 if (obj->currentStateType() == CGhostState::Type::Scatter || 
 			 isChaseState(obj->currentStateType()) ||
@@ -460,7 +697,8 @@ void CPacManGameScene::update(int delta_time)
  void CPacManGameScene::setGhostsToScatterState()
  {
 	 m_ghosts_global_state = GhostStates::scatter;
-	 std::cout << "scatter mode" << std::endl;
+	 if (!m_context->isMuted())
+		 std::cout << "scatter mode" << std::endl;
 	 for (auto& obj : m_ghosts)
 		 if (isChaseState(obj->currentStateType()) || obj->currentStateType() == CGhostState::Type::Frightened)
 			 setGhostState(obj, GhostStates::scatter);
@@ -470,7 +708,8 @@ void CPacManGameScene::update(int delta_time)
  void CPacManGameScene::setGhostsToChaseState()
  {
 	 m_ghosts_global_state = GhostStates::chase;
-	 std::cout << "chase mode" << std::endl;
+	 if (!m_context->isMuted())
+		 std::cout << "chase mode" << std::endl;
 	 for (auto& obj : m_ghosts)
 		 if (obj->currentStateType() == CGhostState::Type::Scatter || obj->currentStateType() == CGhostState::Type::Frightened)
 			 setGhostState(obj, GhostStates::chase);
@@ -483,12 +722,125 @@ void CPacManGameScene::update(int delta_time)
 
 //----------------------------------------------------------------------------------------------
 
-CMainMenuScene::CMainMenuScene()
+std::size_t CObservationEncoder::size(int width, int height)
+{
+	return std::size_t(PLANES) * width * height;
+}
+
+void CObservationEncoder::attach(const CPacManGameScene* scene, sf::Uint8* buffer)
+{
+	m_scene = scene;
+	m_buffer = buffer;
+	m_width = scene->m_walls->getMap()->width();
+	m_height = scene->m_walls->getMap()->height();
+	encodeBoard();
+	update();
+}
+
+// walls, dots and the fixed pill and fruit cells, whenever CDots reports a new board
+void CObservationEncoder::encodeBoard()
+{
+	std::memset(m_buffer, 0, size(m_width, m_height));
+	CWalls* walls = m_scene->m_walls;
+	CDots* dots = m_scene->m_dots;
+
+	for (int y = 0; y < m_height; ++y)
+		for (int x = 0; x < m_width; ++x)
+		{
+			int cell = y * m_width + x;
+			int type = walls->getMapCell(x, y);
+			if (type >= EMapBrickTypes::door_lu && type <= EMapBrickTypes::door_rd)
+				plane(Plane::walls)[cell] = 2;
+			else if (type > EMapBrickTypes::brick_min && type < EMapBrickTypes::brick_max)
+				plane(Plane::walls)[cell] = 1;
+			plane(Plane::dots)[cell] = dots->isDot(x, y) ? 1 : 0;
+		}
+
+	m_pill_count = std::min((int)m_scene->m_pills.size(), (int)MAX_PILLS);
+	for (int i = 0; i < m_pill_count; ++i)
+		m_pill_cells[i] = cellOf(m_scene->m_pills[i]);
+	Vector fruit_cell = m_scene->m_fruit_cell;
+	m_fruit_cell = walls->inBounds(fruit_cell) ? (int)fruit_cell.y * m_width + (int)fruit_cell.x : -1;
+
+	for (int& cell : m_actor_cells)
+		cell = -1;
+	m_dots_version = dots->version();
+	m_dots_seen = 0;
+}
+
+void CObservationEncoder::update()
+{
+	CDots* dots = m_scene->m_dots;
+	if (dots->version() != m_dots_version)
+		encodeBoard();
+
+	sf::Uint8* dots_plane = plane(Plane::dots);
+	for (; m_dots_seen < dots->eatenCount(); ++m_dots_seen)
+	{
+		Vector cell = dots->eatenCell(m_dots_seen);
+		dots_plane[(int)cell.y * m_width + (int)cell.x] = 0;
+	}
+
+	for (int i = 0; i < m_pill_count; ++i)
+		if (m_pill_cells[i] >= 0)
+			plane(Plane::pills)[m_pill_cells[i]] = m_scene->m_pills[i]->isEnabled() ? 1 : 0;
+	if (m_fruit_cell >= 0)
+		plane(Plane::fruit)[m_fruit_cell] = m_scene->m_fruit->isEnabled() && m_scene->m_fruit->isVisible() ? 1 : 0;
+
+	CPacman* pacman = m_scene->m_pacman;
+	moveActor(Plane::pacman, pacman->isEnabled() ? cellOf(pacman) : -1, 1);
+	for (int i = 0; i < 4; ++i)
+	{
+		CGhost* ghost = m_scene->m_ghosts[i];
+		sf::Uint8 state = sf::Uint8(1 + CPacManGameScene::ghostStateOf(ghost));
+		moveActor(Plane(Plane::binky + i), ghost->isEnabled() ? cellOf(ghost) : -1, state);
+	}
+}
+
+int CObservationEncoder::width() const
+{
+	return m_width;
+}
+
+int CObservationEncoder::height() const
+{
+	return m_height;
+}
+
+sf::Uint8* CObservationEncoder::plane(Plane plane)
+{
+	return m_buffer + std::size_t(plane) * m_width * m_height;
+}
+
+int CObservationEncoder::cellOf(CGameObject* actor) const
+{
+	Vector cell = m_scene->m_walls->toMapCoordinates(actor->getPosition());
+	return m_scene->m_walls->inBounds(cell) ? (int)cell.y * m_width + (int)cell.x : -1;
+}
+
+void CObservationEncoder::moveActor(Plane plane, int cell, sf::Uint8 value)
+{
+	sf::Uint8* cells = this->plane(plane);
+	if (m_actor_cells[plane] >= 0)
+		cells[m_actor_cells[plane]] = 0;
+	if (cell >= 0)
+		cells[cell] = value;
+	m_actor_cells[plane] = cell;
+}
+
+//----------------------------------------------------------------------------------------------
+
+CMainMenuScene::CMainMenuScene(CGameContext* context)
 {
-	CPacManGame::instance()->eventManager().subscribe(this);
+	registerType<CMainMenuScene>();
+	m_context = context;
+	m_context->eventManager().subscribe(this);
 
 	m_logo = new CLabel();
-	m_logo->setSprite(sf::Sprite(*CPacManGame::instance()->textureManager().get("texture"), sf::IntRect(5, 148, 240, 50)));
+	sf::Sprite logo;
+	logo.setTextureRect(sf::IntRect(5, 148, 240, 50)); // before the texture, see CSpriteSheet::load
+	logo.setTexture(*m_context->textureManager().get("texture"));
+	m_logo->setSprite(logo);
 	m_logo->setBounds(240, 120, 480, 100);
 	addObject(m_logo);
 
@@ -496,21 +848,21 @@ CMainMenuScene::CMainMenuScene()
 	m_ghost_name->setBounds(300, 280, 360, 75);
 	m_ghost_name->setFontSize(42);
 	m_ghost_name->setFontColor(sf::Color::Black);
-	m_ghost_name->setFontName(*CPacManGame::instance()->fontManager().get("menu_font"));
+	m_ghost_name->setFontName(*m_context->fontManager().get("menu_font"));
 	addObject(m_ghost_name);
 	CTimer* timer;
-	addObject(new CPacman());
-	addObject(new CPill());
+	addObject(new CPacman(m_context));
+	addObject(new CPill(m_context));
 	addObject(timer = new CTimer());
 
 
 	static const char* captions[] = { "New game","Controls", "Exit" };
 	for (int i = 0; i < 3; ++i)
 	{
-		CButton* button = new CButton();
+		CButton* button = new CButton(m_context);
 		button->setBounds(400, 400 + i*70, 170, 40);
 		button->setString(captions[i]);
-		button->setFontName(*CPacManGame::instance()->fontManager().get("menu_font"));
+		button->setFontName(*m_context->fontManager().get("menu_font"));
 		button->setFontColor(sf::Color::Black);
 
 		button->setFontSize(26);
@@ -519,11 +871,11 @@ CMainMenuScene::CMainMenuScene()
 	}
 	m_buttons[2]->onClick([]() { exit(0); });
 
-	auto root = CPacManGame::instance()->getRootObject();
+	auto root = m_context->getRootObject();
 
-	m_buttons[0]->onClick([timer, root]() {root->findObjectByName("game_scene")->turnOn();
-		                                root->findObjectByName<CPacManGameScene>("game_scene")->reset();
-										root->findObjectByName("menu_scene")->turnOff();
+	m_buttons[0]->onClick([timer, root]() {root->findObjectByName(s_game_scene_name)->turnOn();
+		                                root->findObjectByName<CPacManGameScene>(s_game_scene_name)->reset();
+										root->findObjectByName(s_menu_scene_name)->turnOff();
 										timer->clear();
 	});
 
@@ -535,7 +887,7 @@ CMainMenuScene::CMainMenuScene()
 
 	static const char* names[] = { "Binky","Pinky","Inky","Clyde" };
 	for (int i = 0; i < 4; ++i)
-		addObject(m_ghosts[i] = new CGhost(names[i], NULL, NULL));
+		addObject(m_ghosts[i] = new CGhost(m_context, names[i], NULL, NULL));
 			
 
 	
@@ -545,7 +897,7 @@ CMainMenuScene::CMainMenuScene()
 	 
 CMainMenuScene::~CMainMenuScene()
 {
-	CPacManGame::instance()->eventManager().unsubcribe(this);
+	m_context->eventManager().unsubcribe(this);
 }
 
 void CMainMenuScene::reset()
@@ -687,7 +1039,8 @@ CPacManGame* CPacManGame::instance()
 CPacManGame::CPacManGame() : CGame("PacMan", {1000,850})
 {
     textureManager().loadFromFile("texture", "res/sprites.png");
-	textureManager().get("texture")->setSmooth(true);
+	if (!isGpuless())
+		textureManager().get("texture")->setSmooth(true);
 
 	for (auto& font_name : { "arial", "menu_font", "main_font", "score_font" })
 		fontManager().loadFromFile(font_name, "res/fonts/" + std::string(font_name) + ".ttf");
@@ -703,21 +1056,109 @@ CPacManGame::~CPacManGame()
 
 void CPacManGame::init()
 {
-	m_game_scene = new CPacManGameScene();
-	m_main_menu_scene = new CMainMenuScene();
+	m_game_scene = new CPacManGameScene(&context());
+	m_main_menu_scene = new CMainMenuScene(&context());
 	m_game_scene->setName("game_scene");
 	m_main_menu_scene->setName("menu_scene");
+	if (m_autopilot)
+		m_game_scene->setAutopilot(true, m_autopilot_budget);
 	m_game_scene->turnOff();
 	getRootObject()->addObject(m_game_scene);
 	getRootObject()->addObject(m_main_menu_scene);
 	setClearColor(sf::Color::White);
+
+	if (isHeadless()) // nobody to press "New game"
+	{
+		m_main_menu_scene->turnOff();
+		m_game_scene->turnOn();
+		m_game_scene->reset(m_seed);
+	}
+}
+
+bool CPacManGame::isPlaying() const
+{
+	return m_game_scene->isEnabled();
+}
+
+int CPacManGame::score() const
+{
+	return m_game_scene->score();
+}
+
+void CPacManGame::setAutopilot(bool enabled, sf::Time budget)
+{
+	m_autopilot = enabled;
+	m_autopilot_budget = budget;
+	if (m_game_scene)
+		m_game_scene->setAutopilot(enabled, budget);
+}
+
+int CPacManGame::replay(const std::string& file_path, int session, const std::function<void(int tick)>& on_tick)
+{
+	CInputPlayer player;
+	if (!player.loadFromFile(file_path) || !player.selectSession(session))
+		throw std::runtime_error("can't replay input log: " + file_path);
+
+	m_seed = player.seed();
+	inputManager().setPlayer(&player);
+	int tick = 0;
+	int ticks = runHeadless(0, [this, &player, &on_tick, &tick]()
+	{
+		if (on_tick)
+			on_tick(tick++);
+		return !isPlaying() || player.isFinished();
+	});
+	inputManager().setPlayer(NULL);
+	return ticks;
+}
+
+std::vector<int> CPacManGame::simulate(int games, int threads, int max_ticks)
+{
+	std::vector<int> scores(games, 0);
+	std::atomic<int> next_game(0);
+	int delta_time = updateStep().asMilliseconds();
+
+	auto worker = [&]()
+	{
+		// one scene per worker, reset between games; resources are shared with this game
+		CGameContext context(textureManager(), fontManager(), soundManager());
+		context.setMuted(true);
+		CPacManGameScene scene(&context);
+		context.setRootObject(&scene);
+		if (m_autopilot)
+			scene.setAutopilot(true, m_autopilot_budget);
+
+		for (int game = next_game++; game < games; game = next_game++)
+		{
+			scene.turnOn();
+			scene.reset(game);
+			for (int tick = 0; (max_ticks <= 0 || tick < max_ticks) && scene.isEnabled(); ++tick)
+			{
+				scene.applyCommands();
+				scene.update(delta_time);
+			}
+			scores[game] = scene.score();
+		}
+		scene.applyCommands();
+	};
+
+	std::vector<std::thread> workers;
+	for (int i = 1; i < threads; ++i)
+		workers.emplace_back(worker);
+	worker();
+	for (auto& thread : workers)
+		thread.join();
+
+	return scores;
 }
 	
 //---------------------------------------------------------------------------------------------------------
 
-CButton::CButton()
+CButton::CButton(CGameContext* context)
 {
-	CPacManGame::instance()->eventManager().subscribe(this);
+	registerType<CButton>();
+	m_context = context;
+	m_context->eventManager().subscribe(this);
 	m_focus = false;
 	setOutlineColor(sf::Color(200, 200, 220));
 	setOutlineThickness(2);
@@ -726,7 +1167,7 @@ CButton::CButton()
 
 CButton::~CButton()
 {
-	CPacManGame::instance()->eventManager().unsubcribe(this);
+	m_context->eventManager().unsubcribe(this);
 }
 
 void CButton::update(int delta_time)
@@ -784,12 +1225,13 @@ void CButton::events(const sf::Event& event)
 }
 //---------------------------------------------------------------------------------------------------------
 
-CLifeBar::CLifeBar(const Vector& pos)
+CLifeBar::CLifeBar(CGameContext* context, const Vector& pos)
 {
+	registerType<CLifeBar>();
 	setPosition(pos);
-	sf::Texture* texture = CPacManGame::instance()->textureManager().get("texture");
-	m_sprite.setTexture(*texture);
+	sf::Texture* texture = context->textureManager().get("texture");
 	m_sprite.setTextureRect({ 48,32,48,48 });
+	m_sprite.setTexture(*texture);
 }
 
 void CLifeBar::draw(sf::RenderWindow* window) 
@@ -797,7 +1239,7 @@ void CLifeBar::draw(sf::RenderWindow* window)
 	for (int i = 0; i < m_value; ++i)
 	{
 		m_sprite.setPosition( getPosition() + Vector(50, 0)*i) ;
-		window->draw(m_sprite);
+		CSpriteBatch::instance().drawSprite(window, m_sprite);
 	}
 
 }
@@ -808,16 +1250,40 @@ void CLifeBar::setValue(int value)
 }
 
 //------------------------------------------------------------------------------------------------
-CPacman::CPacman(CWalls* walls)
+CKeyboardController::CKeyboardController(CGameContext* context)
+{
+	m_context = context;
+}
+
+Vector CKeyboardController::direction(CPacman* pacman)
+{
+	static std::map<sf::Keyboard::Key,Vector> keys = {{sf::Keyboard::Up,  Vector::up},
+									    {sf::Keyboard::Down, Vector::down},
+									    {sf::Keyboard::Right,Vector::right},
+									    {sf::Keyboard::Left, Vector::left} };
+
+	CInputManager& input_manager = m_context->inputManager();
+	for (auto& key : keys)
+		if (input_manager.isKeyPressed(key.first))
+			return key.second;
+	return Vector::zero;
+}
+
+//------------------------------------------------------------------------------------------------
+CPacman::CPacman(CGameContext* context, CWalls* walls)
 {
+	registerType<CPacman>();
 	setName("Pacman");
+	m_context = context;
 	m_walls = walls;
 	init();
 
 }
 
-CPacman::CPacman()
+CPacman::CPacman(CGameContext* context)
 {
+	registerType<CPacman>();
+	m_context = context;
 	m_walls = NULL;
 	init();
 }
@@ -825,8 +1291,9 @@ CPacman::CPacman()
 void CPacman::init()
 {
 	setName("Player");
+	setInterpolated(true);
 	setDirection(Vector::right);
-	sf::Texture* texture = CPacManGame::instance()->textureManager().get("texture");
+	sf::Texture* texture = m_context->textureManager().get("texture");
 	m_animator.create("right", *texture, { 0,32 }, {48,48},4,1, 0.03, AnimType::forward_backward_cycle);
 	m_animator.create("left", *texture, { 48,32 }, { -48,48 }, 4, 1, 0.03, AnimType::forward_backward_cycle);
 	m_animator.create("down", *texture, { 0,32 }, { 48,48 }, 4, 1, 0.03, AnimType::forward_backward_cycle);
@@ -835,6 +1302,8 @@ void CPacman::init()
 	m_animator.get("down")->setRotation(90);
 	m_waypoint_system = new WaypointSystem();
 	addObject(m_waypoint_system);
+	if (m_walls)
+		m_waypoint_system->setWrapArea(m_walls->wrapArea());
 
 	sf::Keyboard::Key keys[] = {
 		sf::Keyboard::Key::Left,
@@ -845,7 +1314,9 @@ void CPacman::init()
 		sf::Keyboard::Escape};
 
 	for (const auto& key: keys)
-		CPacManGame::instance()->inputManager().registerKey(key);
+		m_context->inputManager().registerKey(key);
+
+	m_controller.reset(new CKeyboardController(m_context));
 }	
 
 
@@ -872,51 +1343,14 @@ void CPacman::update(int delta_time)
 	if (delta_time == 0 || !m_walls)
 		return;
 
-	//Controller component for player
-	static std::map<sf::Keyboard::Key,Vector> keys = {{sf::Keyboard::Up,  Vector::up},
-									    {sf::Keyboard::Down, Vector::down},
-									    {sf::Keyboard::Right,Vector::right},
-									    {sf::Keyboard::Left, Vector::left} };
-			
-	static auto input_manager = CPacManGame::instance()->inputManager();
-
-	Vector input_direction;   
-	for (auto& key : keys)
-		if (input_manager.isKeyPressed(key.first))
-		{
-			input_direction = key.second;
-			break;
-		}
-	            
-			
-	Vector next_cell = m_walls->toMapCoordinates(getPosition()) + input_direction;
-	bool can_turn = !(!m_walls->inBounds(next_cell) || m_walls->getMapCell(next_cell) != EMapBrickTypes::empty);
+	Vector input_direction = m_controller->direction(this);
+	Vector player_cell = m_walls->toMapCoordinates(getPosition());
+	Vector next_cell = m_walls->wrap(player_cell + input_direction);
+	bool can_turn = m_walls->inBounds(next_cell) && m_walls->getMapCell(next_cell) == EMapBrickTypes::empty;
 
+	// through the tunnel too: the path runs past the edge and the waypoints wrap him round
 	if (input_direction != Vector::zero && input_direction != getDirection() && can_turn)
-	{
-		Vector player_cell = m_walls->toMapCoordinates(getPosition());
-		Vector finish_cell = m_walls->getMap()->traceLine(player_cell, input_direction, EMapBrickTypes::empty);
-		m_waypoint_system->addPath(m_walls->toPixelCoordinates({ player_cell,finish_cell }), NORMAL_SPEED);
-	}
-
-	Vector player_pos = m_walls->toMapCoordinates(getPosition());
-
-	//Teleports
-	if ((getDirection() == Vector::left) && getPosition().x < 5)
-	{
-		setPosition(m_walls->toPixelCoordinates({ m_walls->getMap()->width() - 1.f, player_pos.y }));
-		Vector player_cell = m_walls->toMapCoordinates(getPosition());
-		Vector finish_cell = m_walls->getMap()->traceLine(player_cell, Vector::left, EMapBrickTypes::empty);
-		m_waypoint_system->addPath( m_walls->toPixelCoordinates({ player_cell,finish_cell }), NORMAL_SPEED);
-	}
-
-	if ((getDirection() == Vector::right) && getPosition().x > (m_walls->size().x - 30))
-	{
-		setPosition(m_walls->toPixelCoordinates({ 0.f, player_pos.y }));
-		Vector player_cell = m_walls->toMapCoordinates(getPosition());
-		Vector finish_cell = m_walls->getMap()->traceLine(player_cell, Vector::right, EMapBrickTypes::empty);
-		m_waypoint_system->addPath(m_walls->toPixelCoordinates({ player_cell,finish_cell }), NORMAL_SPEED);
-	}
+		m_waypoint_system->addPath(m_walls->straightPath(player_cell, input_direction), NORMAL_SPEED);
 }
 	 
 void CPacman::draw(sf::RenderWindow* window)
@@ -936,12 +1370,46 @@ void CPacman::setMovingPath(const std::vector<Vector>& path)
 	m_waypoint_system->addPath(path, NORMAL_SPEED);
 }
 
+bool CPacman::isMoving() const
+{
+	return m_waypoint_system->isMoving();
+}
+
+void CPacman::setController(std::unique_ptr<CPacmanController> controller)
+{
+	m_controller = std::move(controller);
+}
+
+CPacmanController* CPacman::controller() const
+{
+	return m_controller.get();
+}
+
+void CPacman::saveState(CGameSnapshot::Actor& state) const
+{
+	state.position = getPosition();
+	state.direction = getDirection();
+	state.enabled = isEnabled();
+	state.visible = isVisible();
+	m_waypoint_system->saveState(state.path);
+}
+
+void CPacman::restoreState(const CGameSnapshot::Actor& state)
+{
+	setPosition(state.position);
+	setDirection(state.direction);
+	state.enabled ? enable() : disable();
+	state.visible ? show() : hide();
+	m_waypoint_system->restoreState(state.path);
+}
+
 //-------------------------------------------------------------------------------------------------
 		
-CPill::CPill()
+CPill::CPill(CGameContext* context)
 {
+	registerType<CPill>();
 	setName("Pill");
-	sf::Texture* texture = CPacManGame::instance()->textureManager().get("texture");
+	sf::Texture* texture = context->textureManager().get("texture");
 	m_sprite_sheet.load(*texture, { {192,0,32,32} });
 	m_rot_offset = { m_sprite_sheet[0].getLocalBounds().width / 2,
 						m_sprite_sheet[0].getLocalBounds().height / 2 };
@@ -951,7 +1419,7 @@ CPill::CPill()
 void CPill::draw(sf::RenderWindow* window)
 {
 	m_sprite_sheet.setPosition(getPosition() + m_rot_offset);
-	window->draw(m_sprite_sheet[0]);
+	CSpriteBatch::instance().drawSprite(window, m_sprite_sheet[0]);
 }
 
 void CPill::update(int delta_time)
@@ -961,20 +1429,23 @@ void CPill::update(int delta_time)
 }
 
 //-------------------------------------------------------------------------------------------------
-CFruit::CFruit()
+CFruit::CFruit(CGameContext* context)
 {
+	registerType<CFruit>();
 	setName("Fruit");
-	sf::Texture* texture = CPacManGame::instance()->textureManager().get("texture");
+	sf::Texture* texture = context->textureManager().get("texture");
 	m_sprite_sheet.load(*texture, { { 149,84,40,40 } });
 	m_rot_offset = { m_sprite_sheet[0].getLocalBounds().width / 2,
 		m_sprite_sheet[0].getLocalBounds().height / 2 };
 	m_sprite_sheet[0].setOrigin(m_rot_offset.x, m_rot_offset.y);
+	m_time = 0;
+	m_flashed = false;
 }
 
 void CFruit::draw(sf::RenderWindow* window)
 {
 	m_sprite_sheet.setPosition(getPosition() + m_rot_offset);
-	window->draw(m_sprite_sheet[0]);
+	CSpriteBatch::instance().drawSprite(window, m_sprite_sheet[0]);
 }
 
 void CFruit::update(int delta_time)
@@ -998,16 +1469,34 @@ void CFruit::setFlashed(bool value)
 		show();
 }
 
+bool CFruit::isFlashed() const
+{
+	return m_flashed;
+}
+
+float CFruit::flashTime() const
+{
+	return m_time;
+}
+
+void CFruit::restoreFlash(bool flashed, float time)
+{
+	m_flashed = flashed;
+	m_time = time;
+}
+
 //-------------------------------------------------------------------------------------------------
 
-CGhost::CGhost(const std::string& name,CGameObject* target, CWalls* walls)
+CGhost::CGhost(CGameContext* context, const std::string& name,CGameObject* target, CWalls* walls)
 {
+	registerType<CGhost>();
+	setInterpolated(true);
 	setSpeed(NORMAL_SPEED);
 	setName(name);
 	m_target = target;
 	m_walls = walls;
 
-	sf::Texture* texture = CPacManGame::instance()->textureManager().get("texture");
+	sf::Texture* texture = context->textureManager().get("texture");
 
 	m_sprite_sheet.load(*texture, { {0, 80, 48, 40} , //body
 			                        {60, 83, 26, 11}, { 60, 94, 26, 11 }, { 60, 105, 26, 11 },{ 60, 116, 26, 11}, //eyes
@@ -1028,6 +1517,8 @@ CGhost::CGhost(const std::string& name,CGameObject* target, CWalls* walls)
 
 	m_waypoint_system = new WaypointSystem();
 	addObject(m_waypoint_system);
+	if (m_walls)
+		m_waypoint_system->setWrapArea(m_walls->wrapArea());
 }
 
 
@@ -1036,20 +1527,25 @@ CGhostState::Type CGhost::currentStateType()
 	return m_ghost_state->type();
 }
 
+CGhostState* CGhost::currentState() const
+{
+	return m_ghost_state;
+}
+
 void CGhost::update(int delta_time)
 {
 	CGameObject::update(delta_time);
 	m_time += delta_time;
 	if (m_ghost_state)
-		m_ghost_state->update({ delta_time,this,m_walls });
+		m_ghost_state->update({ delta_time,this,m_walls,m_random });
 };
 
 void CGhost::drawBody(sf::RenderWindow* window)
 {
 	m_sprite_sheet.setPosition(getPosition() - Vector(10, 10));
-	window->draw(m_sprite_sheet[0]);
+	CSpriteBatch::instance().drawSprite(window, m_sprite_sheet[0]);
 	int k = int(m_time / 200) % 4 + 6;	
-	window->draw(m_sprite_sheet[k]);
+	CSpriteBatch::instance().drawSprite(window, m_sprite_sheet[k]);
 }
 
 void CGhost::drawEyes(sf::RenderWindow* window)
@@ -1059,21 +1555,21 @@ void CGhost::drawEyes(sf::RenderWindow* window)
 	if (angle < 0) angle += 360;
 	if (angle > 360) angle -= 360;
 	int index = round(angle / 90) +1;
-	window->draw(m_sprite_sheet[index]);
+	CSpriteBatch::instance().drawSprite(window, m_sprite_sheet[index]);
 	if (getDirection() == Vector::zero)
-		window->draw(m_sprite_sheet[1]);
+		CSpriteBatch::instance().drawSprite(window, m_sprite_sheet[1]);
 }
 
 void CGhost::drawMouth(sf::RenderWindow* window)
 {
 	m_sprite_sheet.setPosition(getPosition() - Vector(10, 10));
-	window->draw(m_sprite_sheet[5]);
+	CSpriteBatch::instance().drawSprite(window, m_sprite_sheet[5]);
 }
 
 void CGhost::draw(sf::RenderWindow* window)
 {
 	if (m_ghost_state)
-		m_ghost_state->draw({0,this,m_walls }, window);
+		m_ghost_state->draw({0,this,m_walls,m_random }, window);
 	else
 	{
 		drawBody(window);
@@ -1086,11 +1582,21 @@ void CGhost::setTarget(CGameObject* target)
 	m_target = target;
 }
 
+void CGhost::setTargetField(CFlowField* field)
+{
+	m_target_field = field;
+}
+
 CGameObject* CGhost::target()
 {
 	return m_target;
 }
 
+void CGhost::setRandom(CRandom* random)
+{
+	m_random = random;
+}
+
 void CGhost::setColor(sf::Color color)
 {
 	m_sprite_sheet[0].setColor(color);
@@ -1106,9 +1612,9 @@ sf::Color CGhost::color() const
 void CGhost::setState(CGhostState* state)
 {
 	if (m_ghost_state != NULL)
-		m_ghost_state->deactivate({ 0,this,m_walls });
+		m_ghost_state->deactivate({ 0,this,m_walls,m_random });
 	m_ghost_state = state;
-	m_ghost_state->activate({ 0,this,m_walls });
+	m_ghost_state->activate({ 0,this,m_walls,m_random });
 }
 
 
@@ -1127,24 +1633,44 @@ void CGhost::moveToTarget(const Vector& target_pos)
 	Vector object_cell = m_walls->toMapCoordinates(getPosition());
 	Vector target_cell = m_walls->toMapCoordinates(target_pos);
 
-	std::vector<Vector> nodes = m_walls->getMap()->getNeighborNodes(object_cell, EMapBrickTypes::empty);
+	auto nodes = m_walls->getMap()->getNeighborNodes(object_cell, EMapBrickTypes::empty);
+
+	Vector back_cell = m_walls->toMapCoordinates(m_target_pos);
+	Vector next_step;
 
-	Vector next_node;
-	float min_dis = 100000;
-	for (auto& node : nodes)
+	// ghosts after Pac-Man himself read the field from his cell, one BFS for all of them
+	bool chasing = m_target_field && m_target && target_cell == m_walls->toMapCoordinates(m_target->getPosition());
+	if (chasing)
+		m_target_field->update(target_cell);
+
+	// else the way around the walls when the target can be reached from every node, else straight line
+	if (!chasing || !m_target_field->direction(nodes, back_cell, next_step))
 	{
-		if (m_walls->toMapCoordinates(m_target_pos) == node) //avoid back move
-			continue;
-		float dis =  (node - target_cell).length();
-		if (min_dis >= dis)
+		int maze_distances[4];
+		bool use_maze = true;
+		for (int i = 0; i < nodes.count; ++i)
 		{
-			min_dis = dis;
-			next_node = node;
+			maze_distances[i] = m_walls->mazeDistance(nodes.cells[i], target_cell);
+			use_maze = maze_distances[i] >= 0 && use_maze;
+		}
+
+		float min_dis = 100000;
+		for (int i = 0; i < nodes.count; ++i)
+		{
+			const Vector& node = nodes.cells[i];
+			if (back_cell == node) //avoid back move
+				continue;
+			float dis = use_maze ? (float)maze_distances[i] : (node - target_cell).length();
+			if (min_dis >= dis)
+			{
+				min_dis = dis;
+				next_step = nodes.steps[i];
+			}
 		}
 	}
 	m_target_pos = m_walls->toPixelCoordinates(object_cell) ;
 
-	m_waypoint_system->addPath(m_walls->toPixelCoordinates({ object_cell,next_node }), getSpeed());
+	m_waypoint_system->addPath(m_walls->toPixelCoordinates({ object_cell, object_cell + next_step }), getSpeed());
 }
 
 void CGhost::setMovingPath(const std::vector<Vector>& path)
@@ -1157,6 +1683,33 @@ void CGhost::stop()
 	m_waypoint_system->stop();
 }
 
+void CGhost::saveState(CGameSnapshot::Ghost& state) const
+{
+	state.position = getPosition();
+	state.direction = getDirection();
+	state.enabled = isEnabled();
+	state.visible = isVisible();
+	m_waypoint_system->saveState(state.path);
+	state.time = m_time;
+	state.speed = m_speed;
+	state.target_pos = m_target_pos;
+	state.color = color();
+}
+
+void CGhost::restoreState(const CGameSnapshot::Ghost& state, CGhostState* ghost_state)
+{
+	setPosition(state.position);
+	setDirection(state.direction);
+	state.enabled ? enable() : disable();
+	state.visible ? show() : hide();
+	m_waypoint_system->restoreState(state.path);
+	m_time = state.time;
+	m_speed = state.speed;
+	m_target_pos = state.target_pos;
+	setColor(state.color);
+	m_ghost_state = ghost_state;
+}
+
 void CGhost::setSpeed(float speed)
 {
 	m_speed = speed;
@@ -1187,13 +1740,14 @@ void CGhostState::draw(const CGhostStateContex& contex, sf::RenderWindow* window
 
 //-------------------------------------------------------------------------------------------------
 
-CWalls::CWalls(int width, int height)
+CWalls::CWalls(CGameContext* context, int width, int height)
 {
-	sf::Texture* texture = CPacManGame::instance()->textureManager().get("texture");
+	registerType<CWalls>();
+	sf::Texture* texture = context->textureManager().get("texture");
 	m_map = new TileMap<EMapBrickTypes>(width, height);
 	m_map->clear(EMapBrickTypes::empty);
+	m_map->setWrapping(true, false); // rows open on both sides are the tunnel
 
-	texture->setSmooth(true);
 	m_sprite_sheet.load(*texture, { 
 	{ 0, 0, 32, 32 },{ 32, 0, 32, 32 },{ 64, 0, 32, 32 },{ 96, 0, -32, 32 },
 	{ 64, 0, 32, 32 },{ 64, 0, 32, 32 },{ 96, 0, 32, 32 },{ 96 + 32, 0, -32, 32 },
@@ -1209,6 +1763,26 @@ CWalls::CWalls(int width, int height)
 	m_sprite_sheet.scale(CLASTER_SIZE / 32.f, CLASTER_SIZE / 32.f);
 }
 
+void CWalls::load(const std::string& file_path)
+{
+	m_level_path = file_path;
+	m_level_key = CDistanceTable::fileKey(file_path);
+	m_map->loadFromFile(
+	{
+		{ '*', EMapBrickTypes::full },
+		{ '.', EMapBrickTypes::dot },
+		{ 'P', EMapBrickTypes::pacman_spawn },
+		{ ' ', EMapBrickTypes::empty },
+		{ 'p', EMapBrickTypes::pill },
+		{ 'G', EMapBrickTypes::ghost_spawn },
+		{ 'F', EMapBrickTypes::fruit },
+		{ '1', EMapBrickTypes::door_lu },
+		{ '2', EMapBrickTypes::door_ru },
+		{ '3', EMapBrickTypes::door_ld },
+		{ '4', EMapBrickTypes::door_rd }
+	}, file_path);
+}
+
 void CWalls::update(int delta_time)
 {
 
@@ -1216,24 +1790,61 @@ void CWalls::update(int delta_time)
 
 void CWalls::draw(sf::RenderWindow* window)
 {
-	Vector off_set;
+	Vector size = Vector(m_map->width(), m_map->height()) * CLASTER_SIZE;
+	sf::RenderStates states(m_sprite_sheet[0].getTexture());
+	bool recording = CSpriteBatch::instance().isRecording();
 
-	sf::RectangleShape retangle(sf::Vector2f(m_map->width()*CLASTER_SIZE, m_map->height()*CLASTER_SIZE));
-	retangle.setPosition(0, 0);
+	if (m_baked_dirty && !recording)
+	{
+		if (!m_baked || m_baked->getSize() != sf::Vector2u((unsigned)size.x, (unsigned)size.y))
+		{
+			m_baked.reset(new sf::RenderTexture());
+			if (!m_baked->create((unsigned)size.x, (unsigned)size.y))
+				m_baked.reset();
+		}
+
+		if (m_baked)
+		{
+			m_baked->clear(sf::Color(255, 255, 255));
+			m_baked->draw(m_vertices, states);
+			m_baked->display();
+			CSoftwareRenderer::textureChanged(&m_baked->getTexture());
+		}
+		m_baked_dirty = false;
+	}
+
+	if (m_baked && !recording)
+	{
+		CSpriteBatch::instance().drawSprite(window, sf::Sprite(m_baked->getTexture()));
+		return;
+	}
+
+	// recording or no render texture support: background and walls are still just two draw calls
+	sf::RectangleShape retangle(sf::Vector2f(size.x, size.y));
 	retangle.setFillColor(sf::Color(255, 255, 255));
-	window->draw(retangle);
+	CSpriteBatch::instance().draw(window, retangle);
+	CSpriteBatch::instance().draw(window, m_vertices, states);
+}
+
+void CWalls::buildVertices()
+{
+	m_vertices.clear();
+	m_vertices.setPrimitiveType(sf::Quads);
 
 	for (int x = 0; x < m_map->width(); ++x)
 		for (int y = 0; y < m_map->height(); ++y)
 		{
 			int num = (int)m_map->getCell(x, y);
-			if (num > EMapBrickTypes::brick_min && num < EMapBrickTypes::brick_max)
-			{
-				auto& sprite = m_sprite_sheet[num - EMapBrickTypes::brick_min];
-				sprite.setPosition(off_set + Vector(x, y)*CLASTER_SIZE);
-				window->draw(sprite);
-			}
+			if (num <= EMapBrickTypes::brick_min || num >= EMapBrickTypes::brick_max)
+				continue;
+
+			auto& sprite = m_sprite_sheet[num - EMapBrickTypes::brick_min];
+			sprite.setPosition(Vector(x, y) * CLASTER_SIZE);
+
+			CSpriteBatch::appendSprite(m_vertices, sprite);
 		}
+
+	m_baked_dirty = true;
 }
 
 void CWalls::lining()
@@ -1311,6 +1922,20 @@ void CWalls::lining()
 						map->getCell(x - 1, y) == EMapBrickTypes::empty)
 						map->setCell(x, y, EMapBrickTypes::out_corn_right_down);
 				}
+
+	map->buildJunctionGraph(EMapBrickTypes::empty);
+
+	// the corridors of a level file never change, so its table is built once and kept next to it
+	if (m_level_key)
+	{
+		std::string cache_path = m_level_path.substr(0, m_level_path.rfind('.')) + ".dist";
+		m_distances = CDistanceTable::shared(m_level_key, map->wrapsHorizontally(), map->wrapsVertically(), cache_path,
+			[map](CDistanceTable& table) { table.build(*map, EMapBrickTypes::empty); });
+	}
+	else
+		m_distances.reset();
+
+	buildVertices();
 }
 
 CWalls::~CWalls()
@@ -1320,7 +1945,24 @@ CWalls::~CWalls()
 			
 Vector CWalls::toMapCoordinates(const Vector& global_pos)
 {
-    return{ (int)round(global_pos.x / CLASTER_SIZE), (int)round(global_pos.y / CLASTER_SIZE) };
+    return m_map->wrap({ (int)round(global_pos.x / CLASTER_SIZE), (int)round(global_pos.y / CLASTER_SIZE) });
+}
+
+Vector CWalls::wrap(const Vector& cell) const
+{
+	return m_map->wrap(cell);
+}
+
+Rect CWalls::wrapArea() const
+{
+	Vector map_size = size();
+	return Rect(-CLASTER_SIZE / 2.f, -CLASTER_SIZE / 2.f, m_map->wrapsHorizontally() ? map_size.x : 0, m_map->wrapsVertically() ? map_size.y : 0);
+}
+
+std::vector<Vector> CWalls::straightPath(const Vector& cell, const Vector& direction)
+{
+	int steps = m_map->traceSteps(cell, direction, EMapBrickTypes::empty);
+	return toPixelCoordinates({ cell, cell + direction * (float)steps });
 }
 
 Vector CWalls::toPixelCoordinates(const Vector& local_pos)
@@ -1360,6 +2002,16 @@ TileMap<EMapBrickTypes>* CWalls::getMap()
 	return m_map;
 }
 
+int CWalls::mazeDistance(const Vector& from_cell, const Vector& to_cell) const
+{
+	return m_distances ? m_distances->distance(from_cell, to_cell) : -1;
+}
+
+const CDistanceTable* CWalls::distances() const
+{
+	return m_distances.get();
+}
+
 bool CWalls::inBounds(const Vector& vec) const
 {
 	return m_map->inBounds(vec);
@@ -1370,11 +2022,14 @@ bool CWalls::isCollide(Rect& rect, EMapBrickTypes allowed_cell_type)
 	Vector lt = rect.leftTop() / CLASTER_SIZE;
 	Vector rb = rect.rightBottom() / CLASTER_SIZE;
 
-	for (int x = lt.x; x < rb.x; ++x)
-		for (int y = lt.y; y < rb.y; ++y)
-			if (m_map->getCell(x, y) != allowed_cell_type)
+	for (int x = (int)std::floor(lt.x); x < rb.x; ++x)
+		for (int y = (int)std::floor(lt.y); y < rb.y; ++y)
+		{
+			Vector cell = m_map->wrap(Vector(x, y)); // past a wrapping edge the other side is hit
+			if (m_map->inBounds(cell) && m_map->getCell(cell) != allowed_cell_type)
 				if (Rect(x*CLASTER_SIZE, y*CLASTER_SIZE, CLASTER_SIZE, CLASTER_SIZE).isIntersect(rect))
 					return true;
+		}
 	return false;
 }
  
@@ -1382,20 +2037,21 @@ bool CWalls::isCollide(Rect& rect, EMapBrickTypes allowed_cell_type)
 
 CDots::CDots(CWalls* walls)
 {
+	registerType<CDots>();
 	m_walls = walls;
-	m_dots_map = new  TileMap<bool>(walls->getMap()->width(), walls->getMap()->height());
-	m_saved_map = new  TileMap<bool>(walls->getMap()->width(), walls->getMap()->height());
+	m_width = walls->getMap()->width();
+	m_height = walls->getMap()->height();
+	if (m_width * m_height > CGameSnapshot::MAX_CELLS) // the dot bitsets are indexed unchecked
+		throw std::runtime_error("map too big for the dots board: " + std::to_string(m_width) + "x" + std::to_string(m_height));
 
+	m_vertices.setPrimitiveType(sf::Triangles);
+	m_first_vertex.assign(m_width * m_height, -1);
 	//fill(walls);
-	m_shape.setRadius(4);
-	m_shape.setOrigin(sf::Vector2f(3, 3));
-	m_shape.setFillColor(sf::Color(0, 162, 232));
-	
 }
 
 CDots::~CDots()
 {
-	delete m_dots_map;
+
 }
 
 void CDots::update(int delta_time)
@@ -1405,38 +2061,83 @@ void CDots::update(int delta_time)
 
 void CDots::draw(sf::RenderWindow* window)
 {
-	for (int x = 0; x < m_dots_map->width(); ++x)
-	for (int y = 0; y < m_dots_map->height(); ++y)
-	if (m_dots_map->getCell(x, y) == true)
-	{
-		m_shape.setPosition(m_walls->toPixelCoordinates(Vector(x+0.5f, y+0.5f)));
-		window->draw(m_shape);
-	}
+	if (m_vertices_dirty)
+		showDots();
+	CSpriteBatch::instance().draw(window, m_vertices);
+}
+
+void CDots::setDotVisible(int index, bool visible)
+{
+	int first = m_first_vertex[index];
+	if (first < 0)
+		return;
+
+	sf::Uint8 alpha = visible ? 255 : 0;
+	for (int i = first; i < first + DOT_VERTICES; ++i)
+		m_vertices[i].color.a = alpha;
+}
+
+void CDots::showDots()
+{
+	m_vertices_dirty = false;
+	for (std::size_t index = 0; index < m_first_vertex.size(); ++index)
+		if (m_first_vertex[index] >= 0)
+			setDotVisible((int)index, m_dots[index]);
+}
+
+int CDots::cellIndex(int x, int y) const
+{
+	assert(x < m_width && y < m_height && x >= 0 && y >= 0);
+	return x * m_height + y;
 }
 
 bool CDots::eat(int x, int y)
 {
-	bool a = m_dots_map->getCell(x, y);
+	int index = cellIndex(x, y);
+	bool a = m_dots[index];
 	if (a)
 	{
 		m_dots_counter--;
-		m_dots_map->setCell(x, y, false);
+		m_dots[index] = false;
+		m_eaten[m_eaten_count++] = (sf::Int16)index;
+		if (!m_vertices_dirty)
+			setDotVisible(index, false);
 	}
 	return a;
 }
 
 void CDots::fill(CWalls* walls)
 {
-    m_saved_map->clear();
+	static const float radius = 4;
+	static const sf::Color color(0, 162, 232);
+
+	m_saved_dots.reset();
+	m_vertices.clear();
+	m_first_vertex.assign(m_width * m_height, -1);
 	m_dots_counter = 0;
-	for (int x = 0; x < m_dots_map->width(); ++x)
-	for (int y = 0; y < m_dots_map->height(); ++y)
+	for (int x = 0; x < m_width; ++x)
+	for (int y = 0; y < m_height; ++y)
 		if (walls->getMapCell(x, y) == EMapBrickTypes::dot)
 		{
-			m_saved_map->setCell(x, y, true);
+			int index = cellIndex(x, y);
+			m_saved_dots[index] = true;
 			m_dots_counter++;
+
+			// where the old 4 px sf::CircleShape with origin (3, 3) was centred
+			Vector center = walls->toPixelCoordinates(Vector(x + 0.5f, y + 0.5f)) + Vector(1, 1);
+			m_first_vertex[index] = (int)m_vertices.getVertexCount();
+			for (int i = 0; i < DOT_SEGMENTS; ++i)
+			{
+				float a0 = 2 * 3.14159265f * i / DOT_SEGMENTS;
+				float a1 = 2 * 3.14159265f * (i + 1) / DOT_SEGMENTS;
+				m_vertices.append(sf::Vertex(sf::Vector2f(center.x, center.y), color));
+				m_vertices.append(sf::Vertex(sf::Vector2f(center.x + radius * cos(a0), center.y + radius * sin(a0)), color));
+				m_vertices.append(sf::Vertex(sf::Vector2f(center.x + radius * cos(a1), center.y + radius * sin(a1)), color));
+			}
 		}
 	m_max_dots = m_dots_counter;
+	m_vertices_dirty = true;
+	boardChanged();
 }
 
 int CDots::maxDots() const
@@ -1446,8 +2147,23 @@ int CDots::maxDots() const
 
 void CDots::reset()
 {
-	m_dots_map->operator=(*m_saved_map);
+	m_dots = m_saved_dots;
 	m_dots_counter = m_max_dots;
+	m_vertices_dirty = true;
+	boardChanged();
+}
+
+void CDots::saveState(std::bitset<CGameSnapshot::MAX_CELLS>& dots) const
+{
+	dots = m_dots;
+}
+
+void CDots::restoreState(const std::bitset<CGameSnapshot::MAX_CELLS>& dots, int amount)
+{
+	m_dots = dots;
+	m_dots_counter = amount;
+	m_vertices_dirty = true; // headless runs never draw, so restoring stays a bitset copy
+	boardChanged();
 }
 
 int CDots::amount() const
@@ -1455,5 +2171,31 @@ int CDots::amount() const
 	return m_dots_counter;
 }
 
+bool CDots::isDot(int x, int y) const
+{
+	return m_dots[cellIndex(x, y)];
+}
+
+sf::Uint32 CDots::version() const
+{
+	return m_version;
+}
+
+int CDots::eatenCount() const
+{
+	return m_eaten_count;
+}
+
+Vector CDots::eatenCell(int i) const
+{
+	return Vector(m_eaten[i] / m_height, m_eaten[i] % m_height);
+}
+
+void CDots::boardChanged()
+{
+	++m_version;
+	m_eaten_count = 0;
+}
+
 //-----------------------------------------------------------------------------
 
@@ -3,10 +3,13 @@
 
 #include <vector>
 #include <array>
+#include <bitset>
 #include "assert.h"
 #include <memory>
 #include <iostream>
 #include "GameEngine.h"
+#include "DistanceTable.h"
+#include "FlowField.h"
 
 class CPacman;
 class CWalls;
@@ -22,6 +25,7 @@ class CLifeBar;
 class CGhostState;
 class CPill;
 class CFruit;
+class CFrightenedState;
 
 enum  EMapBrickTypes {
 	empty=0, brick_min, full, left, right, up, down,
@@ -30,30 +34,152 @@ enum  EMapBrickTypes {
 	door_lu, door_ru, door_ld, door_rd, brick_max, ghost_spawn, pacman_spawn,pill, fruit, dot
 };
 
+// Plain copyable image of a running game scene: no pointers and no heap, so bots can save it,
+// branch and roll back as often as they like. Sprites, sounds and the HUD are not part of it.
+struct CGameSnapshot
+{
+	enum { MAX_CELLS = 32 * 32, MAX_TIMER_EVENTS = 16, MAX_PILLS = 32 };
+
+	struct Actor
+	{
+		Vector position;
+		Vector direction;
+		WaypointSystem::State path;
+		bool enabled;
+		bool visible;
+	};
+
+	struct Ghost : Actor
+	{
+		float time;
+		float speed;
+		Vector target_pos;
+		sf::Color color;
+		sf::Int8 state;      // CPacManGameScene::GhostStates
+		sf::Int8 soul_stage;
+		sf::Color frightened_old_color;
+		float frightened_time;
+	};
+
+	struct Timer
+	{
+		struct Event
+		{
+			sf::Time time;
+			sf::Int16 event;
+			sf::Int16 arg;
+		} events[MAX_TIMER_EVENTS];
+		int size;
+		bool enabled;
+	};
+
+	sf::Uint32 random[4];
+	int score;
+	int lives;
+	sf::Int8 ghosts_global_state;
+	sf::Int8 big_text;
+	bool enabled;
+	bool inky_unlock;
+	bool clyde_unlock;
+	bool frightened_flashed;
+	Actor pacman;
+	Ghost ghosts[4];
+	bool fruit_enabled;
+	bool fruit_visible;
+	bool fruit_flashed;
+	float fruit_time;
+	sf::Uint32 pills;   // bit per pill still on the map, MAX_PILLS of them
+	int dots_amount;
+	std::bitset<MAX_CELLS> dots;
+	Timer timers[4];
+};
+
+// Board view for learning agents: PLANES uint8 planes of width x height cells in a buffer the
+// caller owns, plane-major then row-major, i.e. buffer[(plane * height + y) * width + x].
+// The board is written once; after that a tick only applies the dots eaten since the last
+// update and rewrites the cells actors left and entered. No allocations after attach().
+class CObservationEncoder
+{
+public:
+	enum Plane { walls, dots, pills, fruit, pacman, binky, pinky, inky, clyde, PLANES };
+	// walls: 1 brick, 2 ghost house door; ghosts: 1 + CPacManGameScene::GhostStates; others: 1
+	static std::size_t size(int width, int height);
+	void attach(const CPacManGameScene* scene, sf::Uint8* buffer);
+	void update(); // after every tick
+	int width() const;
+	int height() const;
+private:
+	enum { MAX_PILLS = 32 };
+	sf::Uint8* plane(Plane plane);
+	int cellOf(CGameObject* actor) const;
+	void encodeBoard();
+	void moveActor(Plane plane, int cell, sf::Uint8 value);
+	const CPacManGameScene* m_scene = nullptr;
+	sf::Uint8* m_buffer = nullptr;
+	int m_width = 0, m_height = 0;
+	sf::Uint32 m_dots_version = 0;
+	int m_dots_seen = 0;
+	int m_actor_cells[PLANES];
+	int m_pill_cells[MAX_PILLS];
+	int m_pill_count = 0;
+	int m_fruit_cell = -1;
+};
+
 class CPacManGame : public CGame
 {
 private:
 	CPacManGame();
-	CPacManGameScene* m_game_scene;
+	CPacManGameScene* m_game_scene = nullptr;
 	CMainMenuScene* m_main_menu_scene;
+	sf::Uint64 m_seed = 0;
+	bool m_autopilot = false;
+	sf::Time m_autopilot_budget;
 	void init() override;
 	static CPacManGame* s_instance;
 public:
 	~CPacManGame();
     static CPacManGame* instance();
+	bool isPlaying() const;
+	int score() const;
+	// for the game scene and every simulated one, see CPacManGameScene::setAutopilot
+	void setAutopilot(bool enabled, sf::Time budget);
+	std::vector<int> simulate(int games, int threads, int max_ticks = 0);
+	// on_tick(tick) sees the state after <tick> ticks, starting from 0
+	int replay(const std::string& file_path, int session = 0, const std::function<void(int tick)>& on_tick = nullptr);
  
 };
 
 class CPacManGameScene : public CGameObject
 {
 public:
-	CPacManGameScene();
+	CPacManGameScene(CGameContext* context);
 	~CPacManGameScene();
 	virtual void update(int delta_time) override;
+	virtual void draw(sf::RenderWindow* window) override;
 	virtual void events(const sf::Event& event) override;
-	void reset();
+	void reset(sf::Uint64 seed = 0);
 	void loadStage(const std::string& name);
+	int score() const;
+	// false if the scene doesn't fit one (more pending timer events or pills than it holds), the
+	// snapshot then misses them and mustn't be restored
+	bool saveSnapshot(CGameSnapshot& snapshot) const;
+	void restoreSnapshot(const CGameSnapshot& snapshot);
+	// Pac-Man plays himself (CAutopilot), searching at most budget per decision; off: the keyboard
+	void setAutopilot(bool enabled, sf::Time budget = sf::milliseconds(1));
 private:
+	friend class CObservationEncoder;
+	friend class CAutopilot;
+	enum TimerEvent { start_round, release_ghosts, chase_wave, scatter_wave, respawn, go_to_main_menu,
+	                  fruit_steady, fruit_flash, fruit_gone, frightened_flash, frightened_end, ghost_reborn };
+	enum BigText { no_text, get_ready, win, game_over };
+	CGameContext* m_context;
+	CRandom m_random;
+	void schedule(CTimer* timer, sf::Time time, TimerEvent event, int arg = 0);
+	void onTimer(TimerEvent event, int arg);
+	bool saveTimer(const CTimer* timer, CGameSnapshot::Timer& saved) const;
+	void restoreTimer(CTimer* timer, const CGameSnapshot::Timer& saved);
+	void setBigText(BigText text);
+	void refreshHud();
 	void addScore(int);
 	void resetScore();
 	void enableActors(bool value);
@@ -65,19 +191,24 @@ private:
 	Vector m_fruit_cell;
 	enum Ghosts { Binky, Pinky, Inky, Clyde };
 	enum GhostStates { chase, scatter, frightened, souls, borning, in_ghost_house } m_ghosts_global_state;
+	static GhostStates ghostStateOf(CGhost* ghost);
 	std::array<CGhost*, 4> m_ghosts;
 	std::array<std::map<std::string, CGhostState*>, 6> m_ghost_states;
 	CGhostState* m_ghost_chase_states[4];
+	CFrightenedState* m_frightened_state;
 	CLabel* m_score_label;
 	CLabel* m_dots_label;
 	std::vector<CPill*> m_pills;
 	int m_score;
 	int m_lives;
 	CButton* m_big_text;
+	BigText m_big_text_id = no_text;
+	bool m_hud_dirty = true;
 	CTimer* m_wave_timer, *m_pill_timer, *m_born_timer, *m_fruit_timer;
 	CPacman* m_pacman;
 	CWalls* m_walls;
 	CDots* m_dots;
+	CFlowField m_pacman_field;
 	sf::Sound m_sound;
 	CFlowText* m_flow_text;
 	CLifeBar* m_life_bar;
@@ -96,11 +227,12 @@ private:
 class CMainMenuScene : public CGameObject
 {
 public: 
-	CMainMenuScene();
+	CMainMenuScene(CGameContext* context);
 	~CMainMenuScene();
 	void reset();
 	virtual void events(const sf::Event& event) override;
 private:
+	CGameContext* m_context;
 	CGhostState* m_ghost_states[6];
 	CGhost* m_ghosts[4];
 	CButton* m_buttons[3];
@@ -112,7 +244,7 @@ private:
 class CButton : public CLabel
 {
  public:
-	 CButton();
+	 CButton(CGameContext* context);
 	 ~CButton();
 	 virtual void update(int delta_time) override;
 	 virtual void events(const sf::Event& event) override;
@@ -125,6 +257,7 @@ protected:
 	 void onMouseLeave();
  private:
 	 virtual void draw(sf::RenderWindow* window) override;
+	 CGameContext* m_context;
 	 bool m_focus;
 	 bool m_is_on_cursor = false;
 	 std::function<void()> m_call_back = NULL;
@@ -133,7 +266,7 @@ protected:
 class CLifeBar : public CGameObject
 {
 public:
-	CLifeBar(const Vector& pos);
+	CLifeBar(CGameContext* context, const Vector& pos);
 	void draw(sf::RenderWindow* window) override;
 	void setValue(int value);
 private:
@@ -144,10 +277,11 @@ private:
 class CWalls : public CGameObject
 {
 public:
-	CWalls(int width, int height);
+	CWalls(CGameContext* context, int width, int height);
 	~CWalls();
 	virtual void update(int delta_time) override;
 	virtual void draw(sf::RenderWindow* window) override;
+	void load(const std::string& file_path);
 	void lining();
 	EMapBrickTypes getMapCell(int x, int y) const;
 	EMapBrickTypes getMapCell(const Vector& vector) const;
@@ -155,33 +289,77 @@ public:
 	TileMap<EMapBrickTypes>* getMap();
 	Vector toMapCoordinates(const Vector& global_pos);
 	Vector toPixelCoordinates(const Vector& global_pos);
+	Vector wrap(const Vector& cell) const;
+	// movers leaving it go round to the other side: half a cell past the edges the map wraps at
+	Rect wrapArea() const;
+	// from cell straight on to the last corridor cell before a wall, in pixels; through the tunnel
+	// the path runs past the edge, the mover's wrap area brings it back in
+	std::vector<Vector> straightPath(const Vector& cell, const Vector& direction);
 	Vector alignToMap(const Vector& position) const;
 	std::vector<Vector> toPixelCoordinates(std::vector<Vector>&& path);
 	bool inBounds(const Vector& vec) const;
 	bool isCollide(Rect& rect, EMapBrickTypes allowed_cell_type);
+	// steps between two corridor cells around the walls, -1 if unknown (no table, a wall, unreachable)
+	int mazeDistance(const Vector& from_cell, const Vector& to_cell) const;
+	const CDistanceTable* distances() const;
 private:
+	void buildVertices();
+	std::string m_level_path;
+	sf::Uint64 m_level_key = 0;
+	std::shared_ptr<const CDistanceTable> m_distances;
 	CSpriteSheet m_sprite_sheet;
 	TileMap<EMapBrickTypes>* m_map;
+	// walls only change in lining(): their quads are kept here and baked into m_baked on the next
+	// direct draw; recorded frames get the quads, as the simulation thread must not render to textures
+	sf::VertexArray m_vertices;
+	std::unique_ptr<sf::RenderTexture> m_baked;
+	bool m_baked_dirty = true;
 	const int CLASTER_SIZE = 27;
 };
 
+// decides where Pac-Man heads; he turns that way as soon as the maze lets him
+class CPacmanController
+{
+public:
+	virtual ~CPacmanController() {}
+	// asked every tick, zero keeps him going as he is
+	virtual Vector direction(CPacman* pacman) = 0;
+};
+
+class CKeyboardController : public CPacmanController
+{
+public:
+	CKeyboardController(CGameContext* context);
+	Vector direction(CPacman* pacman) override;
+private:
+	CGameContext* m_context;
+};
+
 class CPacman : public CGameObject
 {
 public:
-	CPacman();
-	CPacman(CWalls* walls);
+	CPacman(CGameContext* context);
+	CPacman(CGameContext* context, CWalls* walls);
 	~CPacman();
 	virtual void update(int delta_time) override;
 	virtual void draw(sf::RenderWindow* window) override;
 	virtual Rect getBounds() const override;
 	void spawn(const Vector& position);
 	void setMovingPath(const std::vector<Vector>& path);
+	bool isMoving() const;
+	void saveState(CGameSnapshot::Actor& state) const;
+	void restoreState(const CGameSnapshot::Actor& state);
+	// the keyboard unless replaced
+	void setController(std::unique_ptr<CPacmanController> controller);
+	CPacmanController* controller() const;
 private:
 	const float NORMAL_SPEED = 0.15f;
 	void init();
+	CGameContext* m_context;
 	Animator m_animator;
 	CWalls* m_walls;
 	WaypointSystem* m_waypoint_system = NULL;
+	std::unique_ptr<CPacmanController> m_controller;
 };
 
 class CDots : public CGameObject
@@ -196,11 +374,31 @@ public:
 	void reset();
 	int amount() const;
 	int maxDots() const;
+	void saveState(std::bitset<CGameSnapshot::MAX_CELLS>& dots) const;
+	void restoreState(const std::bitset<CGameSnapshot::MAX_CELLS>& dots, int amount);
+	bool isDot(int x, int y) const;
+	// dots eaten since the board last changed as a whole (fill, reset, restore); version()
+	// changes with the board, so a reader can tell new entries from a new board
+	sf::Uint32 version() const;
+	int eatenCount() const;
+	Vector eatenCell(int i) const;
 private:
+	enum { DOT_SEGMENTS = 12, DOT_VERTICES = DOT_SEGMENTS * 3 };
+	int cellIndex(int x, int y) const;
+	void setDotVisible(int index, bool visible);
+	void showDots();
 	CWalls* m_walls;
-	sf::CircleShape m_shape;
-	TileMap<bool>* m_dots_map;
-	TileMap<bool>* m_saved_map;
+	// every dot of the level as triangles, an eaten dot just gets alpha 0
+	sf::VertexArray m_vertices;
+	std::vector<int> m_first_vertex; // cell index -> its first vertex, -1 if the cell has no dot
+	bool m_vertices_dirty = true;    // alphas get resynced with m_dots on the next draw
+	std::bitset<CGameSnapshot::MAX_CELLS> m_dots;       // column-major, like TileMap
+	std::bitset<CGameSnapshot::MAX_CELLS> m_saved_dots;
+	std::array<sf::Int16, CGameSnapshot::MAX_CELLS> m_eaten;
+	int m_eaten_count = 0;
+	sf::Uint32 m_version = 0;
+	void boardChanged();
+	int m_width, m_height;
 	int m_max_dots;
 	int m_dots_counter;
 	float m_claster_size;
@@ -209,7 +407,7 @@ private:
 class CPill : public CGameObject
 {
 public:
-	CPill();
+	CPill(CGameContext* context);
 	virtual void draw(sf::RenderWindow* window) override;
 	virtual void update(int delta_time) override;
 private:
@@ -220,10 +418,13 @@ private:
 class CFruit : public CGameObject
 {
 public:
-	CFruit();
+	CFruit(CGameContext* context);
 	virtual void draw(sf::RenderWindow* window) override;
 	virtual void update(int delta_time) override;
 	void setFlashed(bool value);
+	bool isFlashed() const;
+	float flashTime() const;
+	void restoreFlash(bool flashed, float time);
 private:
 	CSpriteSheet m_sprite_sheet;
 	Vector m_rot_offset;
@@ -238,6 +439,7 @@ struct CGhostStateContex
 	int delta_time;
 	CGhost* ghost;
 	CWalls* walls;
+	CRandom* random;
 };
 
 class CGhostState
@@ -261,7 +463,9 @@ protected:
 	CSpriteSheet m_sprite_sheet;
 	CGameObject* m_target;
 	CWalls* m_walls;
+	CRandom* m_random = NULL;
 	CGhostState* m_ghost_state = NULL;
+	CFlowField* m_target_field = NULL;
 	float m_time = 0;
 	Vector m_target_pos;
 	float m_speed = 0;
@@ -271,14 +475,18 @@ public:
 	void setSpeed(float speed);
 	float getSpeed() const;
 	Vector getTargetPos() const;
-	CGhost(const std::string& name, CGameObject* target, CWalls* walls);
+	CGhost(CGameContext* context, const std::string& name, CGameObject* target, CWalls* walls);
 	virtual void update(int delta_time) override;
 	virtual void draw(sf::RenderWindow* window) override;
 	void setTarget(CGameObject* target);
+	// shared field towards the target's cell, used whenever the ghost heads straight for it
+	void setTargetField(CFlowField* field);
 	CGameObject* target();
+	void setRandom(CRandom* random);
 	void setColor(sf::Color color);
 	sf::Color color() const;
 	CGhostState::Type currentStateType();
+	CGhostState* currentState() const;
 	void setState(CGhostState* state);
 	void drawBody(sf::RenderWindow* window);
 	void drawEyes(sf::RenderWindow* window);
@@ -287,6 +495,8 @@ public:
 	void moveToTarget(const Vector& target_pos);
 	void setMovingPath(const std::vector<Vector>& path);
 	void stop();
+	void saveState(CGameSnapshot::Ghost& state) const;
+	void restoreState(const CGameSnapshot::Ghost& state, CGhostState* ghost_state); // no activate()
 };
 
 #endif
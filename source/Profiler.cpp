@@ -0,0 +1,168 @@
+#include "Profiler.h"
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+
+CProfiler& CProfiler::instance()
+{
+	static thread_local CProfiler profiler;
+	return profiler;
+}
+
+CProfiler::CProfiler()
+{
+	clear();
+}
+
+void CProfiler::setEnabled(bool value)
+{
+	m_enabled = value;
+}
+
+void CProfiler::clear()
+{
+	m_nodes.clear();
+	m_stack.clear();
+	m_nodes.push_back(Node());
+	m_nodes[0].name = "root";
+	m_nodes[0].parent = -1;
+	m_current = 0;
+}
+
+void CProfiler::begin(const std::string& name)
+{
+	int child = -1;
+	for (int index : m_nodes[m_current].children)
+		if (m_nodes[index].name == name)
+		{
+			child = index;
+			break;
+		}
+
+	if (child < 0)
+	{
+		child = (int)m_nodes.size();
+		m_nodes.push_back(Node());
+		m_nodes[child].name = name;
+		m_nodes[child].parent = m_current;
+		m_nodes[m_current].children.push_back(child);
+	}
+
+	m_current = child;
+	m_stack.push_back({ child, Clock::now() });
+}
+
+void CProfiler::end()
+{
+	if (m_stack.empty())
+		return;
+
+	Frame frame = m_stack.back();
+	m_stack.pop_back();
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - frame.start).count();
+	m_nodes[frame.node].histogram.add((sf::Uint64)ns);
+	m_current = m_nodes[frame.node].parent;
+}
+
+bool CProfiler::dumpToFile(const std::string& file_path) const
+{
+	std::ofstream file(file_path);
+	if (!file.is_open())
+		return false;
+	writeJson(file);
+	return true;
+}
+
+void CProfiler::writeJson(std::ostream& stream) const
+{
+	writeNode(stream, 0, 0);
+	stream << std::endl;
+}
+
+void CProfiler::writeNode(std::ostream& stream, int index, int indent) const
+{
+	const Node& node = m_nodes[index];
+	const Histogram& histogram = node.histogram;
+	std::string pad(indent * 2, ' ');
+
+	std::string name;
+	for (char c : node.name.empty() ? std::string("(unnamed)") : node.name)
+	{
+		if (c == '"' || c == '\\')
+			name += '\\';
+		name += c;
+	}
+
+	stream << pad << "{ \"name\": \"" << name << "\", \"count\": " << histogram.count;
+	if (histogram.count)
+	{
+		stream << std::fixed << std::setprecision(3)
+			<< ", \"total_ms\": " << histogram.total / 1e6
+			<< ", \"mean_us\": " << histogram.total / 1e3 / histogram.count
+			<< ", \"p50_us\": " << histogram.percentile(0.5) / 1e3
+			<< ", \"p99_us\": " << histogram.percentile(0.99) / 1e3
+			<< ", \"min_us\": " << histogram.min / 1e3
+			<< ", \"max_us\": " << histogram.max / 1e3;
+	}
+
+	if (!node.children.empty())
+	{
+		stream << ", \"children\": [\n";
+		for (std::size_t i = 0; i < node.children.size(); ++i)
+		{
+			writeNode(stream, node.children[i], indent + 1);
+			stream << (i + 1 < node.children.size() ? ",\n" : "\n");
+		}
+		stream << pad << "]";
+	}
+	stream << " }";
+}
+
+//-----------------------------------------------------------------------------------------------
+int CProfiler::Histogram::bucketOf(sf::Uint64 ns)
+{
+	if (ns < SUB_BUCKETS)
+		return (int)ns;
+
+	int msb = 0;
+	for (sf::Uint64 value = ns; value >>= 1; )
+		++msb;
+	int sub = int(ns >> (msb - 2)) & (SUB_BUCKETS - 1);
+	return (msb - 1) * SUB_BUCKETS + sub;
+}
+
+sf::Uint64 CProfiler::Histogram::bucketValue(int bucket)
+{
+	if (bucket < SUB_BUCKETS)
+		return bucket;
+
+	int msb = bucket / SUB_BUCKETS + 1;
+	int sub = bucket % SUB_BUCKETS;
+	sf::Uint64 low = sf::Uint64(SUB_BUCKETS + sub) << (msb - 2);
+	return low + (sf::Uint64(1) << (msb - 2)) / 2; // middle of the bucket
+}
+
+void CProfiler::Histogram::add(sf::Uint64 ns)
+{
+	++counts[bucketOf(ns)];
+	if (count == 0 || ns < min)
+		min = ns;
+	if (ns > max)
+		max = ns;
+	++count;
+	total += ns;
+}
+
+sf::Uint64 CProfiler::Histogram::percentile(double p) const
+{
+	sf::Uint64 rank = std::max<sf::Uint64>(1, (sf::Uint64)std::ceil(p * count)); // nearest rank
+	sf::Uint64 seen = 0;
+	for (int bucket = 0; bucket < BUCKETS; ++bucket)
+	{
+		seen += counts[bucket];
+		if (seen >= rank)
+			return std::max(min, std::min(max, bucketValue(bucket)));
+	}
+	return max;
+}
@@ -0,0 +1,90 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <SFML/Config.hpp>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <ostream>
+
+// Call tree of named scopes ("frame/update/game_scene/Binky"), every node keeps a histogram
+// of its durations so p50/p99 come out without storing samples. One profiler per thread;
+// while it is off a scope costs a single flag check.
+class CProfiler
+{
+public:
+	static CProfiler& instance();
+	void setEnabled(bool value);
+	bool isEnabled() const { return m_enabled; }
+	void begin(const std::string& name);
+	void end();
+	void clear();
+	void writeJson(std::ostream& stream) const;
+	bool dumpToFile(const std::string& file_path) const;
+
+	// log-linear buckets: 4 per power of two, i.e. ~25% resolution from 1 ns to centuries
+	struct Histogram
+	{
+		enum { SUB_BUCKETS = 4, BUCKETS = 64 * SUB_BUCKETS };
+		sf::Uint32 counts[BUCKETS] = {};
+		sf::Uint64 count = 0, total = 0, min = 0, max = 0;
+		void add(sf::Uint64 ns);
+		sf::Uint64 percentile(double p) const;
+		static int bucketOf(sf::Uint64 ns);
+		static sf::Uint64 bucketValue(int bucket);
+	};
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Node
+	{
+		std::string name;
+		int parent;
+		std::vector<int> children;
+		Histogram histogram;
+	};
+
+	struct Frame
+	{
+		int node;
+		Clock::time_point start;
+	};
+
+	CProfiler();
+	void writeNode(std::ostream& stream, int index, int indent) const;
+	std::vector<Node> m_nodes;
+	std::vector<Frame> m_stack;
+	int m_current = 0;
+	bool m_enabled = false;
+};
+
+class CProfileScope
+{
+public:
+	CProfileScope(CProfiler& profiler, const std::string& name) : m_profiler(profiler.isEnabled() ? &profiler : nullptr)
+	{
+		if (m_profiler)
+			m_profiler->begin(name);
+	}
+
+	CProfileScope(CProfiler& profiler, const char* name) : m_profiler(profiler.isEnabled() ? &profiler : nullptr)
+	{
+		if (m_profiler)
+			m_profiler->begin(name);
+	}
+
+	~CProfileScope()
+	{
+		if (m_profiler)
+			m_profiler->end();
+	}
+
+	CProfileScope(const CProfileScope&) = delete;
+	CProfileScope& operator=(const CProfileScope&) = delete;
+
+private:
+	CProfiler* m_profiler;
+};
+
+#endif
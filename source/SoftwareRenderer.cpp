@@ -0,0 +1,430 @@
+#include "SoftwareRenderer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+
+// bumped by textureChanged(), a copy is stale when its version differs
+static std::mutex s_versions_mutex;
+static std::unordered_map<const sf::Texture*, unsigned> s_versions;
+
+static unsigned textureVersion(const sf::Texture* texture)
+{
+	std::lock_guard<std::mutex> lock(s_versions_mutex);
+	auto it = s_versions.find(texture);
+	return it == s_versions.end() ? 0 : it->second;
+}
+
+// stand-in texture -> its image; behind a function, stand-ins may be created by static objects
+static std::unordered_map<const sf::Texture*, const sf::Image*>& standIns(std::unique_lock<std::mutex>& lock)
+{
+	static std::mutex mutex;
+	static std::unordered_map<const sf::Texture*, const sf::Image*> images;
+	lock = std::unique_lock<std::mutex>(mutex);
+	return images;
+}
+
+CTextureStandIn::CTextureStandIn(const sf::Image& image) : m_image(image)
+{
+	std::unique_lock<std::mutex> lock;
+	standIns(lock)[&m_storage.texture] = &m_image;
+}
+
+CTextureStandIn::~CTextureStandIn()
+{
+	std::unique_lock<std::mutex> lock;
+	standIns(lock).erase(&m_storage.texture);
+}
+
+sf::Texture& CTextureStandIn::texture()
+{
+	return m_storage.texture;
+}
+
+const sf::Image* CTextureStandIn::imageOf(const sf::Texture* texture)
+{
+	std::unique_lock<std::mutex> lock;
+	auto& images = standIns(lock);
+	auto it = images.find(texture);
+	return it != images.end() ? it->second : nullptr;
+}
+
+enum class Blend { alpha, add, multiply, none };
+
+static Blend blendOf(const sf::BlendMode& mode)
+{
+	if (mode == sf::BlendAdd)
+		return Blend::add;
+	if (mode == sf::BlendMultiply)
+		return Blend::multiply;
+	if (mode == sf::BlendNone)
+		return Blend::none;
+	return Blend::alpha;
+}
+
+static inline unsigned mul255(unsigned a, unsigned b)
+{
+	return (a * b + 127) / 255;
+}
+
+static inline void blendPixel(sf::Uint8* dst, unsigned r, unsigned g, unsigned b, unsigned a, Blend mode)
+{
+	switch (mode)
+	{
+	case Blend::alpha:
+		if (a == 0)
+			return;
+		if (a < 255)
+		{
+			unsigned inverse = 255 - a;
+			dst[0] = (sf::Uint8)((r * a + dst[0] * inverse + 127) / 255);
+			dst[1] = (sf::Uint8)((g * a + dst[1] * inverse + 127) / 255);
+			dst[2] = (sf::Uint8)((b * a + dst[2] * inverse + 127) / 255);
+			dst[3] = (sf::Uint8)(a + mul255(dst[3], inverse));
+			return;
+		}
+	// fall through
+	case Blend::none:
+		dst[0] = (sf::Uint8)r;
+		dst[1] = (sf::Uint8)g;
+		dst[2] = (sf::Uint8)b;
+		dst[3] = (sf::Uint8)a;
+		return;
+	case Blend::add:
+		dst[0] = (sf::Uint8)std::min(255u, dst[0] + mul255(r, a));
+		dst[1] = (sf::Uint8)std::min(255u, dst[1] + mul255(g, a));
+		dst[2] = (sf::Uint8)std::min(255u, dst[2] + mul255(b, a));
+		dst[3] = (sf::Uint8)std::min(255u, dst[3] + a);
+		return;
+	case Blend::multiply:
+		dst[0] = (sf::Uint8)mul255(dst[0], r);
+		dst[1] = (sf::Uint8)mul255(dst[1], g);
+		dst[2] = (sf::Uint8)mul255(dst[2], b);
+		dst[3] = (sf::Uint8)mul255(dst[3], a);
+		return;
+	}
+}
+
+// nearest texel modulated by the vertex color, as the fixed pipeline does
+static inline void shadePixel(sf::Uint8* dst, const sf::Uint8* texel, const sf::Color& color, Blend mode)
+{
+	if (color == sf::Color::White)
+		blendPixel(dst, texel[0], texel[1], texel[2], texel[3], mode);
+	else
+		blendPixel(dst, mul255(texel[0], color.r), mul255(texel[1], color.g), mul255(texel[2], color.b), mul255(texel[3], color.a), mode);
+}
+
+static inline int texelIndex(float coordinate, unsigned size)
+{
+	return coordinate <= 0 ? 0 : std::min((int)coordinate, (int)size - 1);
+}
+
+void CSoftwareRenderer::create(unsigned width, unsigned height)
+{
+	m_width = width;
+	m_height = height;
+	m_pixels.assign(std::size_t(width) * height * 4, 0);
+}
+
+void CSoftwareRenderer::setTexture(const sf::Texture* texture, const sf::Image& image)
+{
+	Source& source = m_textures[texture];
+	load(source, image);
+	source.registered = true;
+}
+
+void CSoftwareRenderer::clear(const sf::Color& color)
+{
+	if (m_pixels.empty())
+		return;
+
+	// one row by pixels, the others copied from it
+	std::size_t row = std::size_t(m_width) * 4;
+	const sf::Uint8 rgba[4] = { color.r, color.g, color.b, color.a };
+	for (std::size_t i = 0; i < row; i += 4)
+		std::memcpy(&m_pixels[i], rgba, 4);
+	for (std::size_t i = row; i < m_pixels.size(); i += row)
+		std::memcpy(&m_pixels[i], &m_pixels[0], row);
+}
+
+void CSoftwareRenderer::draw(const CDisplayList& list)
+{
+	sf::Vector2f size = list.view.getSize();
+	sf::Vector2f origin = list.view.getCenter() - size * 0.5f;
+	float scale_x = size.x != 0 ? m_width / size.x : 1.f;
+	float scale_y = size.y != 0 ? m_height / size.y : 1.f;
+	const sf::Vertex* vertices = list.vertices();
+
+	for (auto& item : list.items())
+	{
+		const Source* texture = item.texture ? source(item.texture) : nullptr;
+		if (texture && !texture->pixels)
+			continue;
+
+		auto toPoint = [&](const sf::Vertex& vertex)
+		{
+			sf::Vector2f position = item.transform.transformPoint(vertex.position);
+			return Point{ (position.x - origin.x) * scale_x, (position.y - origin.y) * scale_y, vertex.texCoords.x, vertex.texCoords.y, vertex.color };
+		};
+
+		const sf::Vertex* first = vertices + item.first;
+		switch (item.primitive)
+		{
+		case sf::Quads:
+			for (std::size_t i = 0; i + 3 < item.count; i += 4)
+			{
+				Point p[4] = { toPoint(first[i]), toPoint(first[i + 1]), toPoint(first[i + 2]), toPoint(first[i + 3]) };
+				if (!drawRect(p, texture, item.blend))
+				{
+					drawTriangle(p[0], p[1], p[2], texture, item.blend);
+					drawTriangle(p[0], p[2], p[3], texture, item.blend);
+				}
+			}
+			break;
+		case sf::Triangles:
+			for (std::size_t i = 0; i + 2 < item.count; i += 3)
+				drawTriangle(toPoint(first[i]), toPoint(first[i + 1]), toPoint(first[i + 2]), texture, item.blend);
+			break;
+		case sf::TriangleStrip:
+			for (std::size_t i = 0; i + 2 < item.count; ++i)
+				drawTriangle(toPoint(first[i]), toPoint(first[i + 1]), toPoint(first[i + 2]), texture, item.blend);
+			break;
+		case sf::TriangleFan:
+			for (std::size_t i = 1; i + 1 < item.count; ++i)
+				drawTriangle(toPoint(first[0]), toPoint(first[i]), toPoint(first[i + 1]), texture, item.blend);
+			break;
+		default: // points and lines are not used by the game
+			break;
+		}
+	}
+}
+
+unsigned CSoftwareRenderer::width() const
+{
+	return m_width;
+}
+
+unsigned CSoftwareRenderer::height() const
+{
+	return m_height;
+}
+
+const sf::Uint8* CSoftwareRenderer::pixels() const
+{
+	return m_pixels.data();
+}
+
+void CSoftwareRenderer::copyTo(sf::Image& image) const
+{
+	image.create(m_width, m_height, m_pixels.data());
+}
+
+void CSoftwareRenderer::textureChanged(const sf::Texture* texture)
+{
+	std::lock_guard<std::mutex> lock(s_versions_mutex);
+	++s_versions[texture];
+}
+
+const CSoftwareRenderer::Source* CSoftwareRenderer::source(const sf::Texture* texture)
+{
+	Source& source = m_textures[texture];
+	if (source.registered)
+		return &source;
+
+	if (const sf::Image* image = CTextureStandIn::imageOf(texture)) // never changes, never on the GPU
+	{
+		load(source, *image);
+		source.registered = true;
+		return &source;
+	}
+
+	unsigned version = textureVersion(texture);
+	sf::Vector2u size = texture->getSize();
+	if (!source.pixels || source.version != version || source.width != size.x || source.height != size.y)
+	{
+		load(source, texture->copyToImage());
+		source.version = version;
+	}
+	return &source;
+}
+
+void CSoftwareRenderer::load(Source& source, const sf::Image& image)
+{
+	source.image = image;
+	source.width = image.getSize().x;
+	source.height = image.getSize().y;
+	source.pixels = source.width && source.height ? source.image.getPixelsPtr() : nullptr;
+
+	source.opaque = true;
+	for (std::size_t i = 3; source.pixels && i < std::size_t(source.width) * source.height * 4; i += 4)
+		if (source.pixels[i] != 255)
+		{
+			source.opaque = false;
+			break;
+		}
+}
+
+// sprites, rectangles and map tiles: an axis aligned quad with one color is filled row by row,
+// and copied with memcpy when an opaque texture is drawn 1:1
+bool CSoftwareRenderer::drawRect(const Point* p, const Source* texture, const sf::BlendMode& blend)
+{
+	if (p[0].y != p[1].y || p[1].x != p[2].x || p[2].y != p[3].y || p[3].x != p[0].x ||
+		p[0].v != p[1].v || p[1].u != p[2].u || p[2].v != p[3].v || p[3].u != p[0].u ||
+		p[0].color != p[1].color || p[0].color != p[2].color || p[0].color != p[3].color)
+		return false;
+
+	float x0 = p[0].x, x1 = p[1].x, u0 = p[0].u, u1 = p[1].u;
+	float y0 = p[0].y, y1 = p[3].y, v0 = p[0].v, v1 = p[3].v;
+	if (x1 < x0)
+	{
+		std::swap(x0, x1);
+		std::swap(u0, u1);
+	}
+	if (y1 < y0)
+	{
+		std::swap(y0, y1);
+		std::swap(v0, v1);
+	}
+
+	// pixels whose centers are inside [x0, x1) x [y0, y1)
+	int left = std::max(0, (int)std::ceil(x0 - 0.5f)), right = std::min((int)m_width, (int)std::ceil(x1 - 0.5f));
+	int top = std::max(0, (int)std::ceil(y0 - 0.5f)), bottom = std::min((int)m_height, (int)std::ceil(y1 - 0.5f));
+	if (left >= right || top >= bottom)
+		return true;
+
+	float du = (u1 - u0) / (x1 - x0), dv = (v1 - v0) / (y1 - y0);
+	float u_left = u0 + (left + 0.5f - x0) * du;
+	const sf::Color& color = p[0].color;
+	Blend mode = blendOf(blend);
+	const sf::Uint8* pixels = texture ? texture->pixels : nullptr;
+	unsigned width = texture ? texture->width : 0, height = texture ? texture->height : 0;
+
+	// opaque texels in a plain alpha blend just replace the destination
+	bool opaque = texture && color == sf::Color::White && (mode == Blend::none || (mode == Blend::alpha && texture->opaque));
+	bool copy = opaque && du == 1 && dv == 1;
+	int tx = (int)std::floor(u_left);
+	if (copy && (tx < 0 || tx + (right - left) > (int)width))
+		copy = false;
+
+	// 16.16 texel steps when the whole row stays inside the texture
+	float u_right = u_left + (right - left - 1) * du;
+	bool fixed = texture && std::min(u_left, u_right) >= 0 && std::max(u_left, u_right) < width;
+	sf::Int64 u_fixed = (sf::Int64)(u_left * 65536), du_fixed = (sf::Int64)(du * 65536);
+
+	for (int y = top; y < bottom; ++y)
+	{
+		sf::Uint8* dst = &m_pixels[(std::size_t(y) * m_width + left) * 4];
+		if (!pixels)
+		{
+			for (int x = left; x < right; ++x, dst += 4)
+				blendPixel(dst, color.r, color.g, color.b, color.a, mode);
+			continue;
+		}
+
+		const sf::Uint8* row = pixels + std::size_t(texelIndex(v0 + (y + 0.5f - y0) * dv, height)) * width * 4;
+		if (copy)
+		{
+			std::memcpy(dst, row + tx * 4, std::size_t(right - left) * 4);
+			continue;
+		}
+
+		if (fixed)
+		{
+			sf::Int64 u = u_fixed;
+			if (opaque)
+				for (int x = left; x < right; ++x, u += du_fixed, dst += 4)
+					std::memcpy(dst, row + (u >> 16) * 4, 4);
+			else
+				for (int x = left; x < right; ++x, u += du_fixed, dst += 4)
+					shadePixel(dst, row + (u >> 16) * 4, color, mode);
+			continue;
+		}
+
+		float u = u_left;
+		for (int x = left; x < right; ++x, u += du, dst += 4)
+			shadePixel(dst, row + texelIndex(u, width) * 4, color, mode);
+	}
+	return true;
+}
+
+void CSoftwareRenderer::drawTriangle(const Point& a, const Point& b, const Point& c, const Source* texture, const sf::BlendMode& blend)
+{
+	float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	if (area == 0)
+		return;
+
+	if (!texture && a.color.a == 0 && b.color.a == 0 && c.color.a == 0 && blendOf(blend) != Blend::none)
+		return; // hidden by alpha, like eaten dots
+
+	// ordered so that every edge function is positive inside
+	const Point& p0 = a;
+	const Point& p1 = area > 0 ? b : c;
+	const Point& p2 = area > 0 ? c : b;
+	area = std::abs(area);
+
+	// pixels whose centers can be inside
+	int left = std::max(0, (int)std::ceil(std::min({ p0.x, p1.x, p2.x }) - 0.5f));
+	int right = std::min((int)m_width - 1, (int)std::floor(std::max({ p0.x, p1.x, p2.x }) - 0.5f));
+	int top = std::max(0, (int)std::ceil(std::min({ p0.y, p1.y, p2.y }) - 0.5f));
+	int bottom = std::min((int)m_height - 1, (int)std::floor(std::max({ p0.y, p1.y, p2.y }) - 0.5f));
+	if (left > right || top > bottom)
+		return;
+
+	// a pixel center exactly on an edge belongs to one of the two triangles sharing it
+	auto edge = [](const Point& from, const Point& to, float x, float y)
+	{
+		return (to.x - from.x) * (y - from.y) - (to.y - from.y) * (x - from.x);
+	};
+	auto owns = [](const Point& from, const Point& to)
+	{
+		float dy = to.y - from.y;
+		return dy > 0 || (dy == 0 && to.x < from.x);
+	};
+	bool own0 = owns(p1, p2), own1 = owns(p2, p0), own2 = owns(p0, p1);
+	// edge functions are linear, one pixel to the right adds -dy
+	float step0 = p1.y - p2.y, step1 = p2.y - p0.y, step2 = p0.y - p1.y;
+
+	bool flat = p0.color == p1.color && p0.color == p2.color;
+	Blend mode = blendOf(blend);
+	const sf::Uint8* pixels = texture ? texture->pixels : nullptr;
+	unsigned width = texture ? texture->width : 0, height = texture ? texture->height : 0;
+	float inverse_area = 1.f / area;
+
+	for (int y = top; y <= bottom; ++y)
+	{
+		float cx = left + 0.5f, cy = y + 0.5f;
+		float w0 = edge(p1, p2, cx, cy), w1 = edge(p2, p0, cx, cy), w2 = edge(p0, p1, cx, cy);
+		sf::Uint8* dst = &m_pixels[(std::size_t(y) * m_width + left) * 4];
+
+		for (int x = left; x <= right; ++x, w0 += step0, w1 += step1, w2 += step2, dst += 4)
+		{
+			if (w0 < 0 || w1 < 0 || w2 < 0 || (w0 == 0 && !own0) || (w1 == 0 && !own1) || (w2 == 0 && !own2))
+				continue;
+
+			if (flat && !pixels)
+			{
+				blendPixel(dst, p0.color.r, p0.color.g, p0.color.b, p0.color.a, mode);
+				continue;
+			}
+
+			float l0 = w0 * inverse_area, l1 = w1 * inverse_area, l2 = w2 * inverse_area;
+			sf::Color color = p0.color;
+			if (!flat)
+				color = sf::Color(
+					(sf::Uint8)(p0.color.r * l0 + p1.color.r * l1 + p2.color.r * l2 + 0.5f),
+					(sf::Uint8)(p0.color.g * l0 + p1.color.g * l1 + p2.color.g * l2 + 0.5f),
+					(sf::Uint8)(p0.color.b * l0 + p1.color.b * l1 + p2.color.b * l2 + 0.5f),
+					(sf::Uint8)(p0.color.a * l0 + p1.color.a * l1 + p2.color.a * l2 + 0.5f));
+
+			if (!pixels)
+			{
+				blendPixel(dst, color.r, color.g, color.b, color.a, mode);
+				continue;
+			}
+
+			int u = texelIndex(p0.u * l0 + p1.u * l1 + p2.u * l2, width);
+			int v = texelIndex(p0.v * l0 + p1.v * l1 + p2.v * l2, height);
+			shadePixel(dst, pixels + (std::size_t(v) * width + u) * 4, color, mode);
+		}
+	}
+}
@@ -0,0 +1,80 @@
+#ifndef SOFTWARERENDERER_H
+#define SOFTWARERENDERER_H
+
+#include "SpriteBatch.h"
+#include <unordered_map>
+#include <vector>
+
+// Takes the place of an sf::Texture where no GL object may be created (see CGame::setGpuless):
+// sprites and display lists only keep its address and CSoftwareRenderer draws the image kept
+// with it. The texture itself is never constructed, so nothing may call its members.
+class CTextureStandIn
+{
+public:
+	explicit CTextureStandIn(const sf::Image& image);
+	~CTextureStandIn();
+	CTextureStandIn(const CTextureStandIn&) = delete;
+	CTextureStandIn& operator=(const CTextureStandIn&) = delete;
+	sf::Texture& texture();
+	// the image texture stands in for, nullptr for a real texture
+	static const sf::Image* imageOf(const sf::Texture* texture);
+
+private:
+	union Storage
+	{
+		Storage() {}
+		~Storage() {}
+		sf::Texture texture;
+	};
+	Storage m_storage;
+	sf::Image m_image;
+};
+
+// Rasterizes display lists into an RGBA buffer on the CPU, for capturing frames where there is
+// no GPU to spare. Covers what the game draws: colored and textured triangles and quads with
+// alpha, add, multiply or no blending and nearest texel sampling. The list's view is scaled to
+// the buffer, so the layout matches the window at any resolution. Stand-in textures are drawn
+// from their images; real ones without a copy are read back, which takes a GL context.
+class CSoftwareRenderer
+{
+public:
+	void create(unsigned width, unsigned height);
+	// CPU copy of texture's pixels; textures without one are downloaded on first use
+	void setTexture(const sf::Texture* texture, const sf::Image& image);
+	void clear(const sf::Color& color);
+	void draw(const CDisplayList& list);
+	unsigned width() const;
+	unsigned height() const;
+	const sf::Uint8* pixels() const;
+	void copyTo(sf::Image& image) const;
+	// call after drawing into a texture (font pages, render textures), so copies are refreshed
+	static void textureChanged(const sf::Texture* texture);
+
+private:
+	struct Source
+	{
+		sf::Image image;
+		const sf::Uint8* pixels = nullptr;
+		unsigned width = 0, height = 0;
+		unsigned version = 0;
+		bool opaque = false;
+		bool registered = false;
+	};
+
+	struct Point
+	{
+		float x, y;
+		float u, v;
+		sf::Color color;
+	};
+
+	const Source* source(const sf::Texture* texture);
+	void load(Source& source, const sf::Image& image);
+	bool drawRect(const Point* p, const Source* texture, const sf::BlendMode& blend);
+	void drawTriangle(const Point& a, const Point& b, const Point& c, const Source* texture, const sf::BlendMode& blend);
+	std::vector<sf::Uint8> m_pixels;
+	unsigned m_width = 0, m_height = 0;
+	std::unordered_map<const sf::Texture*, Source> m_textures;
+};
+
+#endif
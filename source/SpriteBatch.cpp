@@ -0,0 +1,255 @@
+#include "SpriteBatch.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+void CDisplayList::clear()
+{
+	m_vertices.clear();
+	m_items.clear();
+	m_spans.clear();
+}
+
+void CDisplayList::add(const sf::Vertex* vertices, std::size_t count, sf::PrimitiveType primitive, const sf::RenderStates& states)
+{
+	if (count == 0)
+		return;
+
+	m_items.push_back({ m_vertices.size(), count, primitive, states.texture, states.blendMode, states.transform });
+	m_vertices.insert(m_vertices.end(), vertices, vertices + count);
+}
+
+void CDisplayList::addSpan(const Span& span)
+{
+	if (span.count > 0)
+		m_spans.push_back(span);
+}
+
+void CDisplayList::replay(sf::RenderTarget& target) const
+{
+	drawItems(target, m_vertices.data());
+}
+
+void CDisplayList::replay(sf::RenderTarget& target, const std::vector<Span>& previous, float alpha, float max_distance) const
+{
+	static thread_local std::vector<sf::Vertex> moved;
+	bool copied = false;
+
+	for (auto& span : m_spans)
+	{
+		auto from = std::find_if(previous.begin(), previous.end(), [&span](const Span& other) { return other.key == span.key; });
+		if (from == previous.end())
+			continue;
+
+		sf::Vector2f delta = from->anchor - span.anchor;
+		if (delta == sf::Vector2f() || std::abs(delta.x) > max_distance || std::abs(delta.y) > max_distance)
+			continue;
+
+		if (!copied)
+		{
+			moved.assign(m_vertices.begin(), m_vertices.end());
+			copied = true;
+		}
+		sf::Vector2f offset = delta * (1.f - alpha);
+		for (std::size_t i = span.first; i < span.first + span.count; ++i)
+			moved[i].position += offset;
+	}
+
+	drawItems(target, copied ? moved.data() : m_vertices.data());
+}
+
+void CDisplayList::drawItems(sf::RenderTarget& target, const sf::Vertex* vertices) const
+{
+	for (auto& item : m_items)
+	{
+		sf::RenderStates states(item.transform);
+		states.texture = item.texture;
+		states.blendMode = item.blend;
+		target.draw(vertices + item.first, item.count, item.primitive, states);
+	}
+}
+
+std::size_t CDisplayList::size() const
+{
+	return m_items.size();
+}
+
+std::size_t CDisplayList::vertexCount() const
+{
+	return m_vertices.size();
+}
+
+const std::vector<CDisplayList::Item>& CDisplayList::items() const
+{
+	return m_items;
+}
+
+const sf::Vertex* CDisplayList::vertices() const
+{
+	return m_vertices.data();
+}
+
+const std::vector<CDisplayList::Span>& CDisplayList::spans() const
+{
+	return m_spans;
+}
+
+void CDisplayList::swapSpans(std::vector<Span>& spans)
+{
+	m_spans.swap(spans);
+}
+
+//-----------------------------------------------------------------------------------------------
+CSpriteBatch& CSpriteBatch::instance()
+{
+	static thread_local CSpriteBatch batch;
+	return batch;
+}
+
+CSpriteBatch::CSpriteBatch()
+{
+	m_vertices.setPrimitiveType(sf::Quads);
+	m_shape_vertices.setPrimitiveType(sf::Quads);
+}
+
+void CSpriteBatch::drawSprite(sf::RenderTarget* target, const sf::Sprite& sprite, const sf::BlendMode& blend)
+{
+	if (target != m_target || sprite.getTexture() != m_texture || blend != m_blend)
+	{
+		flush();
+		m_target = target;
+		m_texture = sprite.getTexture();
+		m_blend = blend;
+	}
+
+	appendSprite(m_vertices, sprite);
+	++m_frame.sprites;
+}
+
+void CSpriteBatch::draw(sf::RenderTarget* target, const sf::VertexArray& vertices, const sf::RenderStates& states)
+{
+	flush();
+	submit(target, vertices, states);
+}
+
+// fill plus the outline ring outside of it, as sf::RectangleShape draws them (untextured shapes only)
+void CSpriteBatch::draw(sf::RenderTarget* target, const sf::RectangleShape& shape)
+{
+	flush();
+
+	const sf::Transform& transform = shape.getTransform();
+	sf::Vector2f size = shape.getSize();
+	float t = shape.getOutlineThickness();
+	auto quad = [this, &transform](float left, float top, float right, float bottom, const sf::Color& color)
+	{
+		m_shape_vertices.append(sf::Vertex(transform.transformPoint(left, top), color));
+		m_shape_vertices.append(sf::Vertex(transform.transformPoint(right, top), color));
+		m_shape_vertices.append(sf::Vertex(transform.transformPoint(right, bottom), color));
+		m_shape_vertices.append(sf::Vertex(transform.transformPoint(left, bottom), color));
+	};
+
+	m_shape_vertices.clear();
+	quad(0, 0, size.x, size.y, shape.getFillColor());
+	if (t != 0)
+	{
+		const sf::Color& color = shape.getOutlineColor();
+		float outer = std::min(0.f, -t), inner = std::max(0.f, -t); // negative thickness grows inwards
+		quad(outer, outer, size.x - outer, inner, color);
+		quad(outer, size.y - inner, size.x - outer, size.y - outer, color);
+		quad(outer, inner, inner, size.y - inner, color);
+		quad(size.x - inner, inner, size.x - outer, size.y - inner, color);
+	}
+	submit(target, m_shape_vertices, sf::RenderStates::Default);
+}
+
+void CSpriteBatch::flush()
+{
+	if (m_vertices.getVertexCount() == 0)
+		return;
+
+	sf::RenderStates states(m_texture);
+	states.blendMode = m_blend;
+	submit(m_target, m_vertices, states);
+	m_vertices.clear();
+}
+
+void CSpriteBatch::submit(sf::RenderTarget* target, const sf::VertexArray& vertices, const sf::RenderStates& states)
+{
+	if (vertices.getVertexCount() == 0)
+		return;
+
+	if (m_list)
+		m_list->add(&vertices[0], vertices.getVertexCount(), vertices.getPrimitiveType(), states);
+	else
+		target->draw(vertices, states);
+	++m_frame.draw_calls;
+}
+
+void CSpriteBatch::endFrame()
+{
+	flush();
+	m_last_frame = m_frame;
+	m_frame = Stats();
+}
+
+void CSpriteBatch::beginRecording(CDisplayList* list)
+{
+	flush();
+	m_list = list;
+	m_list->clear();
+}
+
+void CSpriteBatch::endRecording()
+{
+	flush();
+	m_list = nullptr;
+	m_in_span = false;
+}
+
+bool CSpriteBatch::isRecording() const
+{
+	return m_list != nullptr;
+}
+
+// pending sprites land at the end of the list on the next flush, so a span can be addressed
+// in list vertices before anything is flushed
+void CSpriteBatch::beginSpan(const void* key, const sf::Vector2f& anchor)
+{
+	if (!m_list)
+		return;
+
+	assert(!m_in_span);
+	m_span = { m_list->vertexCount() + m_vertices.getVertexCount(), 0, key, anchor };
+	m_in_span = true;
+}
+
+void CSpriteBatch::endSpan()
+{
+	if (!m_in_span)
+		return;
+
+	m_span.count = m_list->vertexCount() + m_vertices.getVertexCount() - m_span.first;
+	m_list->addSpan(m_span);
+	m_in_span = false;
+}
+
+const CSpriteBatch::Stats& CSpriteBatch::lastFrame() const
+{
+	return m_last_frame;
+}
+
+// the same corners and (possibly mirrored) texture coordinates sf::Sprite draws with
+void CSpriteBatch::appendSprite(sf::VertexArray& vertices, const sf::Sprite& sprite)
+{
+	const sf::Transform& transform = sprite.getTransform();
+	sf::FloatRect bounds = sprite.getLocalBounds();
+	sf::IntRect rect = sprite.getTextureRect();
+	float left = (float)rect.left, right = left + rect.width;
+	float top = (float)rect.top, bottom = top + rect.height;
+	const sf::Color& color = sprite.getColor();
+
+	vertices.append(sf::Vertex(transform.transformPoint(0, 0), color, sf::Vector2f(left, top)));
+	vertices.append(sf::Vertex(transform.transformPoint(bounds.width, 0), color, sf::Vector2f(right, top)));
+	vertices.append(sf::Vertex(transform.transformPoint(bounds.width, bounds.height), color, sf::Vector2f(right, bottom)));
+	vertices.append(sf::Vertex(transform.transformPoint(0, bounds.height), color, sf::Vector2f(left, bottom)));
+}
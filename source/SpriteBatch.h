@@ -0,0 +1,96 @@
+#ifndef SPRITEBATCH_H
+#define SPRITEBATCH_H
+
+#include <SFML/Graphics.hpp>
+#include <vector>
+
+// A frame as plain data: vertices plus the states each run of them is drawn with. The
+// simulation records one, a renderer replays it later, possibly on another thread.
+class CDisplayList
+{
+public:
+	struct Item
+	{
+		std::size_t first;
+		std::size_t count;
+		sf::PrimitiveType primitive;
+		const sf::Texture* texture;
+		sf::BlendMode blend;
+		sf::Transform transform;
+	};
+
+	// the vertices one interpolated object drew and where that object was
+	struct Span
+	{
+		std::size_t first;
+		std::size_t count;
+		const void* key;
+		sf::Vector2f anchor;
+	};
+
+	void clear();
+	void add(const sf::Vertex* vertices, std::size_t count, sf::PrimitiveType primitive, const sf::RenderStates& states);
+	void addSpan(const Span& span);
+	void replay(sf::RenderTarget& target) const;
+	// draws every span moved back towards its anchor in previous by 1 - alpha; objects that
+	// jumped further than max_distance (teleport, respawn, restore) are drawn where they are
+	void replay(sf::RenderTarget& target, const std::vector<Span>& previous, float alpha, float max_distance = 64) const;
+	std::size_t size() const;
+	std::size_t vertexCount() const;
+	const std::vector<Item>& items() const;
+	const sf::Vertex* vertices() const;
+	const std::vector<Span>& spans() const;
+	void swapSpans(std::vector<Span>& spans);
+	sf::View view;
+	sf::Time time; // when the recorded state was current, on the recorder's clock
+
+private:
+	void drawItems(sf::RenderTarget& target, const sf::Vertex* vertices) const;
+	std::vector<sf::Vertex> m_vertices;
+	std::vector<Item> m_items;
+	std::vector<Span> m_spans;
+};
+
+// Collects consecutive sprites that share a texture and blend mode into one vertex array and
+// submits them with a single draw. Anything else drawn through it flushes first, so the order
+// on screen is exactly the order of the calls. One batch per thread, like the profiler.
+// While recording, draws go into a display list instead of the target.
+class CSpriteBatch
+{
+public:
+	struct Stats
+	{
+		int draw_calls = 0;
+		int sprites = 0;
+	};
+
+	static CSpriteBatch& instance();
+	void drawSprite(sf::RenderTarget* target, const sf::Sprite& sprite, const sf::BlendMode& blend = sf::BlendAlpha);
+	void draw(sf::RenderTarget* target, const sf::VertexArray& vertices, const sf::RenderStates& states = sf::RenderStates::Default);
+	void draw(sf::RenderTarget* target, const sf::RectangleShape& shape);
+	void flush();
+	void endFrame();
+	void beginRecording(CDisplayList* list);
+	void endRecording();
+	bool isRecording() const;
+	// marks what key draws in between as one span of the display list (no-op when not recording)
+	void beginSpan(const void* key, const sf::Vector2f& anchor);
+	void endSpan();
+	const Stats& lastFrame() const;
+	static void appendSprite(sf::VertexArray& vertices, const sf::Sprite& sprite);
+
+private:
+	CSpriteBatch();
+	void submit(sf::RenderTarget* target, const sf::VertexArray& vertices, const sf::RenderStates& states);
+	sf::RenderTarget* m_target = nullptr;
+	const sf::Texture* m_texture = nullptr;
+	sf::BlendMode m_blend;
+	sf::VertexArray m_vertices;
+	sf::VertexArray m_shape_vertices;
+	CDisplayList* m_list = nullptr;
+	CDisplayList::Span m_span;
+	bool m_in_span = false;
+	Stats m_frame, m_last_frame;
+};
+
+#endif
@@ -4,6 +4,11 @@
 #include "Geometry.h"
 #include <vector>
 #include <functional>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <string>
+#include "assert.h"
 
 const static Vector directions[] = { Vector::zero,Vector::left, Vector::up,Vector::down,Vector::right };
 
@@ -31,6 +36,7 @@ public:
 	{
 		assert(x < m_width && y < m_height && x >= 0 && y >= 0);
         m_map[x][y] = value;
+		m_graph_valid = false;
 	}
 
 	inline const T& getCell(int x, int y) const
@@ -47,6 +53,7 @@ public:
 
 	void clear(T value = T())
 	{
+		m_graph_valid = false;
 		for (int x = 0; x < m_width; ++x)
 			for (int y = 0; y < m_height; ++y)
 				m_map[x][y] = value;
@@ -69,6 +76,7 @@ public:
 		if (!file.is_open())
 			std::runtime_error("Can't load file: " + FilePath);
 		std::string str;
+		m_graph_valid = false;
 		for (int y = 0; y < height(); ++y)
 		{
 			std::getline(file, str);
@@ -83,6 +91,47 @@ public:
 		return cell.x >= 0 && cell.y >= 0 && cell.x < m_width && cell.y < m_height;
 	}
 
+	bool inBounds(int x, int y) const
+	{
+		return x >= 0 && y >= 0 && x < m_width && y < m_height;
+	}
+
+	// along a wrapping axis the cells on opposite edges are neighbors (the tunnel)
+	void setWrapping(bool horizontal, bool vertical)
+	{
+		m_wrap_x = horizontal;
+		m_wrap_y = vertical;
+		m_graph_valid = false;
+	}
+
+	bool wrapsHorizontally() const
+	{
+		return m_wrap_x;
+	}
+
+	bool wrapsVertically() const
+	{
+		return m_wrap_y;
+	}
+
+	// into the map along wrapping axes, unchanged along the others
+	Vector wrap(const Vector& cell) const
+	{
+		Vector result = cell;
+		if (m_wrap_x && (cell.x < 0 || cell.x >= m_width))
+			result.x -= std::floor(cell.x / m_width) * m_width;
+		if (m_wrap_y && (cell.y < 0 || cell.y >= m_height))
+			result.y -= std::floor(cell.y / m_height) * m_height;
+		return result;
+	}
+
+	// the cell one step away, false if the step leaves the map
+	bool neighbor(const Vector& cell, const Vector& direction, Vector& result) const
+	{
+		result = wrap(cell + direction);
+		return inBounds(result);
+	}
+
     int getCellDegree(const Vector& cell, const T& cellType) const
     {
         if (getCell(cell) != cellType)
@@ -91,8 +140,9 @@ public:
         int degree = 0;
         static const Vector deltas[]{ { 1,0 },{ -1,0 },{ 0,1 },{ 0,-1 } };
 
+        Vector next;
         for (auto& delta : deltas)
-            if (inBounds(cell + delta) && getCell(cell + delta) == cellType)
+            if (neighbor(cell, delta, next) && getCell(next) == cellType)
                 ++degree;
 
         return degree;
@@ -109,21 +159,27 @@ public:
         return 	cells;
     }
 
-    Vector traceLine(const Vector& start_cell, const Vector& direction, const T& allowedCellType)
+    // cells from start_cell to the last allowed one before a wall, counted on past a wrapping edge
+    int traceSteps(const Vector& start_cell, const Vector& direction, const T& allowedCellType) const
     {
-        Vector curr_cell = floor(start_cell);
+        Vector curr_cell = floor(start_cell), next_cell;
         assert(getCell(curr_cell) == allowedCellType);
 
         if (direction == Vector::zero)
-            return curr_cell;
-
-        while (inBounds(curr_cell) && getCell(curr_cell) == allowedCellType)
-            curr_cell += direction;
+            return 0;
 
-        curr_cell += -direction;
+        int steps = 0, limit = direction.x != 0 ? m_width : m_height;
+        while (steps < limit && neighbor(curr_cell, direction, next_cell) && getCell(next_cell) == allowedCellType)
+        {
+            curr_cell = next_cell;
+            ++steps;
+        }
+        return steps;
+    }
 
-        assert(getCell(curr_cell) == allowedCellType);
-        return curr_cell;
+    Vector traceLine(const Vector& start_cell, const Vector& direction, const T& allowedCellType) const
+    {
+        return wrap(floor(start_cell) + direction * (float)traceSteps(start_cell, direction, allowedCellType));
     }
 
     Vector getCell(const Vector& start_cell, const Vector& direction, int length)
@@ -134,25 +190,156 @@ public:
         return cur_cell;
     }
 
-    std::vector<Vector> getNeighborNodes(const Vector& start_cell, const T& allowedCellType)
-    {
+	// at most one per direction, in the order of directions[]; steps is the offset to the node,
+	// which runs past the edge of a wrapping map rather than jumping to the other side
+	struct NeighborNodes
+	{
+		Vector cells[4];
+		Vector steps[4];
+		int count = 0;
+		const Vector* begin() const { return cells; }
+		const Vector* end() const { return cells + count; }
+		std::size_t size() const { return count; }
+		void add(const Vector& cell, const Vector& step)
+		{
+			cells[count] = cell;
+			steps[count++] = step;
+		}
+	};
 
-        Vector curr_cell;
-        std::vector<Vector> nodes;
+	// where a straight walk stops: junctions (degree 3+), corners and dead ends. next[i] is the node
+	// reached leaving in directions[i + 1], -1 if a wall is in the way; length counts the cells to it
+	struct JunctionNode
+	{
+		Vector cell;
+		int next[4];
+		int length[4];
+	};
+
+	// walks from start_cell in every direction until a junction or a wall, through the tunnel of a
+	// wrapping map; answered from the junction graph while it is built for allowedCellType and
+	// the map hasn't changed since. Without wrapping, nodes on the left and right edges lead nowhere
+	NeighborNodes getNeighborNodes(const Vector& start_cell, const T& allowedCellType) const
+	{
+		NeighborNodes nodes;
 
-        for (int i = 1; i < 5; ++i)
-        {
-            curr_cell = start_cell;
+		if (m_graph_valid && allowedCellType == m_graph_type && inBounds(start_cell))
+		{
+			const int* reach = &m_reach[cellIndex((int)start_cell.x, (int)start_cell.y) * 4];
+			for (int i = 0; i < 4; ++i)
+				if (reach[i] >= 0)
+				{
+					const Vector& cell = m_nodes[reach[i]].cell;
+					if (m_wrap_x || (cell.x != 0 && cell.x != m_width - 1))
+						nodes.add(cell, directions[i + 1] * (float)walkLength(start_cell, cell, i));
+				}
+			return nodes;
+		}
 
-            while ((curr_cell == start_cell || getCellDegree(curr_cell, allowedCellType) < 3) && inBounds(curr_cell + directions[i]) && getCell(curr_cell + directions[i]) == allowedCellType)
-                curr_cell += directions[i];
+		Vector curr_cell, next_cell;
+		for (int i = 1; i < 5; ++i)
+		{
+			curr_cell = start_cell;
+			int steps = 0, limit = directions[i].x != 0 ? m_width : m_height;
+
+			while ((steps == 0 || getCellDegree(curr_cell, allowedCellType) < 3) && steps < limit &&
+				neighbor(curr_cell, directions[i], next_cell) && getCell(next_cell) == allowedCellType)
+			{
+				curr_cell = next_cell;
+				++steps;
+			}
+
+			if (steps > 0 && steps < limit && (m_wrap_x || (curr_cell.x != 0 && curr_cell.x != m_width - 1)))
+				nodes.add(curr_cell, directions[i] * (float)steps);
+		}
 
-            if (curr_cell != start_cell && curr_cell.x != 0 && curr_cell.x != m_width - 1)
-                nodes.push_back(curr_cell);
-        }
+		return nodes;
+	}
 
-        return nodes;
-    }
+	// call after the map is final (any setCell drops the graph); runs are followed until they
+	// stop, every cell on the way remembers where, those stops become the nodes
+	void buildJunctionGraph(const T& allowedCellType)
+	{
+		const int unknown = -2;
+		int cells = m_width * m_height;
+		std::vector<int> stop(cells * 4, unknown);
+		std::vector<int> run;
+		for (int i = 0; i < 4; ++i)
+		{
+			const Vector& direction = directions[i + 1];
+			int limit = direction.x != 0 ? m_width : m_height;
+			for (int start = 0; start < cells; ++start)
+			{
+				if (stop[start * 4 + i] != unknown || m_map[start / m_height][start % m_height] != allowedCellType)
+					continue;
+
+				run.clear();
+				int index = start, result = -1;
+				while (true)
+				{
+					run.push_back(index);
+					Vector cell(index / m_height, index % m_height), next;
+					if (!neighbor(cell, direction, next) || getCell(next) != allowedCellType || getCellDegree(cell, allowedCellType) >= 3)
+					{
+						result = index;
+						break;
+					}
+					index = cellIndex((int)next.x, (int)next.y);
+					if (stop[index * 4 + i] != unknown)
+					{
+						result = stop[index * 4 + i];
+						break;
+					}
+					if ((int)run.size() >= limit) // a ring without junctions never stops
+						break;
+				}
+				for (int cell : run)
+					stop[cell * 4 + i] = result;
+			}
+		}
+
+		m_nodes.clear();
+		std::vector<int> node_of(cells, -1);
+		for (int index : stop)
+			if (index >= 0 && node_of[index] < 0)
+			{
+				node_of[index] = (int)m_nodes.size();
+				m_nodes.push_back(JunctionNode{ Vector(index / m_height, index % m_height), { -1, -1, -1, -1 }, { 0, 0, 0, 0 } });
+			}
+
+		m_reach.assign(cells * 4, -1);
+		for (int x = 0; x < m_width; ++x)
+			for (int y = 0; y < m_height; ++y)
+				for (int i = 0; i < 4; ++i)
+				{
+					Vector next;
+					if (!neighbor(Vector(x, y), directions[i + 1], next) || getCell(next) != allowedCellType)
+						continue;
+					int end = stop[cellIndex((int)next.x, (int)next.y) * 4 + i];
+					if (end >= 0 && end != cellIndex(x, y)) // all the way round is no move
+						m_reach[cellIndex(x, y) * 4 + i] = node_of[end];
+				}
+
+		for (auto& node : m_nodes)
+			for (int i = 0; i < 4; ++i)
+			{
+				node.next[i] = m_reach[cellIndex((int)node.cell.x, (int)node.cell.y) * 4 + i];
+				node.length[i] = node.next[i] < 0 ? 0 : walkLength(node.cell, m_nodes[node.next[i]].cell, i);
+			}
+
+		m_graph_type = allowedCellType;
+		m_graph_valid = true;
+	}
+
+	bool hasJunctionGraph() const
+	{
+		return m_graph_valid;
+	}
+
+	const std::vector<JunctionNode>& junctionNodes() const
+	{
+		return m_nodes;
+	}
 
 	TileMap& operator=(const TileMap& other_map)
 	{
@@ -166,8 +353,27 @@ public:
 	}
 
 private:
+	int cellIndex(int x, int y) const
+	{
+		return x * m_height + y;
+	}
+
+	// steps from one cell to another straight along directions[i + 1], around the edge if need be
+	int walkLength(const Vector& from, const Vector& to, int i) const
+	{
+		const Vector& direction = directions[i + 1];
+		int size = direction.x != 0 ? m_width : m_height;
+		int delta = (int)((to.x - from.x) * direction.x + (to.y - from.y) * direction.y);
+		return (delta % size + size) % size;
+	}
+
 	T** m_map;
 	int m_height,m_width;
+	std::vector<JunctionNode> m_nodes;
+	std::vector<int> m_reach; // per cell and direction: the node a walk that way stops at, or -1
+	T m_graph_type = T();
+	bool m_graph_valid = false;
+	bool m_wrap_x = false, m_wrap_y = false;
 };
 
 #endif TILEMAP_H